@@ -0,0 +1,86 @@
+/*
+ * xstr_bench - measure xstr build throughput
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage: xstr_bench [megabytes]
+ *
+ * Builds a string of given size (100 MB by default) with each of the append functions and prints
+ * the throughput. Build it against an older libpjf to compare.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "main.h"
+
+#define CHUNK "0123456789"
+#define CHUNK_LEN 10
+
+static struct timeval t0;
+
+static void start(void)
+{
+	pjf_timenow(&t0);
+}
+
+static void stop(const char *name, xstr *xs)
+{
+	struct timeval t1;
+	double s;
+
+	pjf_timenow(&t1);
+	s = pjf_timediff(&t1, &t0) / 1e6;
+
+	printf("%-24s %10zu bytes in %7.3f s = %8.1f MB/s\n",
+		name, (size_t) xs->len, s, s > 0 ? xs->len / s / 1e6 : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+	mmatic *mm = mmatic_create();
+	size_t size, i;
+	xstr *xs;
+
+	size = (argc > 1 ? strtoul(argv[1], NULL, 10) : 100) * 1000 * 1000;
+
+	start();
+	xs = xstr_create("", mm);
+	for (i = 0; i < size; i++)
+		xstr_append_char(xs, 'a' + i % 26);
+	stop("xstr_append_char()", xs);
+	xstr_free(xs);
+
+	start();
+	xs = xstr_create("", mm);
+	for (i = 0; i < size / CHUNK_LEN; i++)
+		xstr_append(xs, CHUNK);
+	stop("xstr_append() 10 B", xs);
+	xstr_free(xs);
+
+	start();
+	xs = xstr_create("", mm);
+	for (i = 0; i < size / CHUNK_LEN; i++)
+		xstr_append_size(xs, CHUNK, CHUNK_LEN);
+	stop("xstr_append_size() 10 B", xs);
+	xstr_free(xs);
+
+	mmatic_destroy(mm);
+	return 0;
+}
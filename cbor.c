@@ -0,0 +1,696 @@
+/*
+ * cbor - binary encoding of unitype values
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "lib.h"
+
+/* major types */
+#define CBOR_UINT   0
+#define CBOR_NEGINT 1
+#define CBOR_BYTES  2
+#define CBOR_TEXT   3
+#define CBOR_ARRAY  4
+#define CBOR_MAP    5
+#define CBOR_TAG    6
+#define CBOR_SIMPLE 7
+
+/** Additional information of indefinite-length items, and of the "break" stop code */
+#define CBOR_INDEF  31
+#define CBOR_BREAK  0xff
+
+/** Typed array tags of RFC 8746, in big endian - the TAG_LE bit marks little endian */
+#define TAG_UINT32  66
+#define TAG_INT64   75
+#define TAG_FLOAT64 82
+#define TAG_LE      4
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define TAG_HOST TAG_LE
+#else
+#define TAG_HOST 0
+#endif
+
+/****************************************************************/
+
+/** Encoder state */
+struct enc {
+	xstr *xs;           /** output */
+	int fd;             /** if >= 0, flush xs there when it reaches CBOR_WRITE_BUF */
+	ssize_t total;      /** bytes written to fd so far, -1 after an error */
+};
+
+static void flush(struct enc *e)
+{
+	if (e->total >= 0 && e->xs->len > 0) {
+		if (xstr_write_fd_range(e->xs, e->fd, 0, e->xs->len) < 0)
+			e->total = -1;
+		else
+			e->total += e->xs->len;
+	}
+
+	e->xs->len = 0;
+}
+
+/** Return place for n bytes at the end of output; advance xs->len after filling it */
+static inline uint8_t *room(struct enc *e, size_t n)
+{
+	xstr *xs = e->xs;
+
+	if (e->fd >= 0 && xs->len + n > CBOR_WRITE_BUF)
+		flush(e);
+
+	if (!xs->s || xs->a - xs->len < n)
+		xstr_grow(xs, xs->len + n);
+
+	return (uint8_t *) xs->s + xs->len;
+}
+
+static void put(struct enc *e, const void *data, size_t len)
+{
+	size_t k;
+
+	while (len > 0) {
+		k = len;
+		if (e->fd >= 0) {
+			if (e->xs->len == CBOR_WRITE_BUF)
+				flush(e);
+			k = MIN(k, CBOR_WRITE_BUF - e->xs->len);
+		}
+
+		memcpy(room(e, k), data, k);
+		e->xs->len += k;
+		data = (const char *) data + k;
+		len -= k;
+	}
+}
+
+static inline void put_byte(struct enc *e, uint8_t b)
+{
+	*room(e, 1) = b;
+	e->xs->len++;
+}
+
+/** Write n bytes of v, most significant first */
+static inline void put_be(uint8_t *p, uint64_t v, int n)
+{
+	while (n-- > 0) {
+		p[n] = v;
+		v >>= 8;
+	}
+}
+
+/** Write initial byte of major type mt with argument v, in the shortest form */
+static void put_head(struct enc *e, int mt, uint64_t v)
+{
+	uint8_t *p = room(e, 9);
+	int n;
+
+	if (v < 24) {
+		p[0] = (mt << 5) | v;
+		e->xs->len += 1;
+		return;
+	}
+
+	if (v <= UINT8_MAX)       { p[0] = (mt << 5) | 24; n = 1; }
+	else if (v <= UINT16_MAX) { p[0] = (mt << 5) | 25; n = 2; }
+	else if (v <= UINT32_MAX) { p[0] = (mt << 5) | 26; n = 4; }
+	else                      { p[0] = (mt << 5) | 27; n = 8; }
+
+	put_be(p + 1, v, n);
+	e->xs->len += 1 + n;
+}
+
+static void put_text(struct enc *e, const char *s, size_t len)
+{
+	put_head(e, CBOR_TEXT, len);
+	put(e, s, len);
+}
+
+static void put_int(struct enc *e, int64_t v)
+{
+	if (v >= 0)
+		put_head(e, CBOR_UINT, v);
+	else
+		put_head(e, CBOR_NEGINT, (uint64_t) (-1 - v));
+}
+
+/** Write double as single precision float if that loses nothing, else as double */
+static void put_double(struct enc *e, double v)
+{
+	uint8_t *p = room(e, 9);
+	float f = v;
+	uint64_t u64;
+	uint32_t u32;
+
+	if ((double) f == v) {
+		memcpy(&u32, &f, 4);
+		p[0] = (CBOR_SIMPLE << 5) | 26;
+		put_be(p + 1, u32, 4);
+		e->xs->len += 5;
+	} else {
+		memcpy(&u64, &v, 8);
+		p[0] = (CBOR_SIMPLE << 5) | 27;
+		put_be(p + 1, u64, 8);
+		e->xs->len += 9;
+	}
+}
+
+static void put_vector(struct enc *e, struct ut_vector *vec)
+{
+	size_t size;
+
+	switch (vec->type) {
+		case UTV_INT64:
+			put_head(e, CBOR_TAG, TAG_INT64 + TAG_HOST);
+			size = sizeof(int64_t);
+			break;
+		case UTV_UINT32:
+			put_head(e, CBOR_TAG, TAG_UINT32 + TAG_HOST);
+			size = sizeof(uint32_t);
+			break;
+		case UTV_DOUBLE:
+		default:
+			put_head(e, CBOR_TAG, TAG_FLOAT64 + TAG_HOST);
+			size = sizeof(double);
+			break;
+	}
+
+	put_head(e, CBOR_BYTES, vec->n * size);
+	put(e, vec->v, vec->n * size);
+}
+
+static void encode_value(struct enc *e, ut *var)
+{
+	struct ut_bytes *b;
+	uint32_t i;
+	char *k;
+	ut *el;
+
+	switch (ut_type(var)) {
+		case T_STRING:
+			put_text(e, var->d.as_xstr->s ? var->d.as_xstr->s : "", var->d.as_xstr->len);
+			break;
+
+		case T_BYTES:
+			b = var->d.as_bytes;
+			put_head(e, CBOR_BYTES, b->len);
+			put(e, b->s, b->len);
+			break;
+
+		case T_INT:
+			put_int(e, var->d.as_int);
+			break;
+
+		case T_UINT:
+			put_head(e, CBOR_UINT, var->d.as_uint);
+			break;
+
+		case T_INT64:
+			put_int(e, var->d.as_int64);
+			break;
+
+		case T_UINT64:
+			put_head(e, CBOR_UINT, var->d.as_uint64);
+			break;
+
+		case T_DOUBLE:
+			put_double(e, var->d.as_double);
+			break;
+
+		case T_LIST:
+			put_head(e, CBOR_ARRAY, tlist_count(var->d.as_tlist));
+			tlist_iter_loop(var->d.as_tlist, el)
+				encode_value(e, el);
+			break;
+
+		case T_ARRAY:
+			put_head(e, CBOR_ARRAY, uta_count(var));
+			uta_iter_loop(var, i, el)
+				encode_value(e, el);
+			break;
+
+		case T_VECTOR:
+			put_vector(e, var->d.as_vector);
+			break;
+
+		case T_HASH:
+			put_head(e, CBOR_MAP, thash_count(var->d.as_thash));
+			thash_iter_loop(var->d.as_thash, k, el) {
+				put_text(e, k, strlen(k));
+				encode_value(e, el);
+			}
+			break;
+
+		case T_BOOL:
+			put_byte(e, var->d.as_bool ? 0xf5 : 0xf4);
+			break;
+
+		case T_ERR:
+			put_head(e, CBOR_MAP, var->d.as_err->data ? 3 : 2);
+			put_text(e, "code", 4);
+			put_int(e, var->d.as_err->code);
+			put_text(e, "message", 7);
+			put_text(e, var->d.as_err->msg, strlen(var->d.as_err->msg));
+			if (var->d.as_err->data) {
+				put_text(e, "data", 4);
+				put_text(e, var->d.as_err->data, strlen(var->d.as_err->data));
+			}
+			break;
+
+		case T_NULL:
+		default:
+			put_byte(e, 0xf6);
+			break;
+	}
+}
+
+void cbor_append(xstr *xs, ut *var)
+{
+	struct enc e = { xs, -1, 0 };
+
+	encode_value(&e, var);
+	if (xs->s)
+		xs->s[xs->len] = '\0';
+}
+
+xstr *cbor_encode(ut *var, void *mm)
+{
+	xstr *xs = xstr_create("", mm);
+
+	cbor_append(xs, var);
+	return xs;
+}
+
+ssize_t cbor_write_fd(ut *var, int fd, void *mm)
+{
+	struct enc e = { xstr_create("", mm), fd, 0 };
+
+	xstr_reserve(e.xs, CBOR_WRITE_BUF);
+	encode_value(&e, var);
+	flush(&e);
+
+	xstr_free(e.xs);
+	mmatic_free(e.xs);
+	return e.total;
+}
+
+/****************************************************************/
+
+/** Decoder state */
+struct dec {
+	const uint8_t *start;  /** beginning of input */
+	const uint8_t *p;      /** next byte */
+	const uint8_t *end;    /** end of input */
+	int flags;             /** CBOR_* flags */
+	int depth;             /** current nesting */
+	void *mm;              /** memory for values */
+};
+
+static ut *decode_value(struct dec *d);
+
+static ut *err(struct dec *d, int code, const char *msg)
+{
+	return ut_new_err(code, msg, mmatic_sprintf(d->mm, "i=%d", (int) (d->p - d->start)), d->mm);
+}
+
+/** True if len more bytes are available */
+static inline bool have(struct dec *d, uint64_t len)
+{
+	return len <= (uint64_t) (d->end - d->p);
+}
+
+/** Read initial byte and its argument
+ * @param info   set to additional information, eg. CBOR_INDEF
+ * @param val    set to argument, or 0 for CBOR_INDEF
+ * @retval NULL  success */
+static ut *read_head(struct dec *d, int *mt, int *info, uint64_t *val)
+{
+	uint64_t v = 0;
+	int i, n;
+
+	if (!have(d, 1))
+		return err(d, 1, "cbor: unexpected end of data");
+
+	*mt = *d->p >> 5;
+	*info = *d->p & 31;
+	d->p++;
+
+	if (*info < 24) {
+		*val = *info;
+		return NULL;
+	} else if (*info == CBOR_INDEF) {
+		*val = 0;
+		return NULL;
+	} else if (*info > 27) {
+		return err(d, 2, "cbor: reserved additional information");
+	}
+
+	n = 1 << (*info - 24);
+	if (!have(d, n))
+		return err(d, 1, "cbor: unexpected end of data");
+
+	for (i = 0; i < n; i++)
+		v = (v << 8) | d->p[i];
+
+	d->p += n;
+	*val = v;
+	return NULL;
+}
+
+/** Skip "break" stop code if it is next
+ * @retval true  it was */
+static inline bool at_break(struct dec *d)
+{
+	if (d->p < d->end && *d->p == CBOR_BREAK) {
+		d->p++;
+		return true;
+	}
+
+	return false;
+}
+
+static ut *new_uint(struct dec *d, uint64_t v)
+{
+	if (v <= INT_MAX)
+		return ut_new_int(v, d->mm);
+	else if (v <= INT64_MAX)
+		return ut_new_int64(v, d->mm);
+	else
+		return ut_new_uint64(v, d->mm);
+}
+
+static ut *new_string(struct dec *d, int mt, const void *s, size_t len)
+{
+	/* text needs a copy for its trailing \0, even with CBOR_REF */
+	if (mt == CBOR_TEXT)
+		return ut_new_view(xsv_size(s, len), d->mm);
+	else if (d->flags & CBOR_REF)
+		return ut_new_bytes_ref(s, len, d->mm);
+	else
+		return ut_new_bytes(s, len, d->mm);
+}
+
+static ut *decode_string(struct dec *d, int mt, int info, uint64_t len)
+{
+	const uint8_t *s;
+	xstr *xs;
+	int cmt, cinfo;
+	ut *rv;
+
+	if (info != CBOR_INDEF) {
+		if (!have(d, len))
+			return err(d, 1, "cbor: unexpected end of data");
+
+		s = d->p;
+		d->p += len;
+		return new_string(d, mt, s, len);
+	}
+
+	/* indefinite length: join the chunks */
+	xs = xstr_create("", d->mm);
+	while (!at_break(d)) {
+		rv = read_head(d, &cmt, &cinfo, &len);
+		if (rv) return rv;
+
+		if (cmt != mt || cinfo == CBOR_INDEF)
+			return err(d, 3, "cbor: invalid chunk of string");
+		if (!have(d, len))
+			return err(d, 1, "cbor: unexpected end of data");
+
+		xstr_append_size(xs, (const char *) d->p, len);
+		d->p += len;
+	}
+
+	if (mt == CBOR_TEXT)
+		return ut_new_xstr(xs, d->mm);
+
+	rv = ut_new_bytes(xs->s, xs->len, d->mm);
+	xstr_free(xs);
+	mmatic_free(xs);
+	return rv;
+}
+
+static ut *decode_array(struct dec *d, bool indef, uint64_t n)
+{
+	tlist *list = NULL;
+	uint64_t i;
+	ut *arr, *val;
+
+	/* each item takes at least a byte - do not trust n any more than that */
+	if (!indef && !have(d, n))
+		return err(d, 1, "cbor: unexpected end of data");
+	if (++d->depth > CBOR_MAX_DEPTH)
+		return err(d, 4, "cbor: data too deep");
+
+	if (d->flags & CBOR_COMPACT) {
+		arr = ut_new_array(indef ? 0 : MIN(n, UINT32_MAX), d->mm);
+	} else {
+		arr = ut_new_uttlist(NULL, d->mm);
+		list = arr->d.as_tlist;
+	}
+
+	for (i = 0; indef || i < n; i++) {
+		if (indef && at_break(d))
+			break;
+
+		val = decode_value(d);
+		if (!ut_ok(val)) return val;
+
+		if (list)
+			tlist_push(list, val);
+		else
+			uta_add(arr, val);
+	}
+
+	d->depth--;
+	return arr;
+}
+
+static ut *decode_map(struct dec *d, bool indef, uint64_t n)
+{
+	const char *key;
+	uint64_t i, len;
+	int mt, info;
+	ut *hash, *val, *rv;
+
+	if (!indef && !have(d, n))
+		return err(d, 1, "cbor: unexpected end of data");
+	if (++d->depth > CBOR_MAX_DEPTH)
+		return err(d, 4, "cbor: data too deep");
+
+	hash = ut_new_utthash(NULL, d->mm);
+
+	for (i = 0; indef || i < n; i++) {
+		if (indef && at_break(d))
+			break;
+
+		rv = read_head(d, &mt, &info, &len);
+		if (rv) return rv;
+
+		if (mt != CBOR_TEXT || info == CBOR_INDEF)
+			return err(d, 5, "cbor: map key is not a text string");
+		if (!have(d, len))
+			return err(d, 1, "cbor: unexpected end of data");
+
+		key = (const char *) d->p;
+		d->p += len;
+
+		val = decode_value(d);
+		if (!ut_ok(val)) return val;
+
+		thash_set_len(hash->d.as_thash, key, len, val);
+	}
+
+	d->depth--;
+	return hash;
+}
+
+/** Decode typed array of given element type, from byte string which is next */
+static ut *decode_vector(struct dec *d, enum ut_vtype type, bool swap)
+{
+	struct ut_vector *vec;
+	size_t size = (type == UTV_UINT32) ? sizeof(uint32_t) : sizeof(uint64_t);
+	uint64_t len, n, i;
+	int mt, info;
+	ut *var, *rv;
+
+	rv = read_head(d, &mt, &info, &len);
+	if (rv) return rv;
+
+	if (!have(d, len))
+		return err(d, 1, "cbor: unexpected end of data");
+	if (len % size != 0 || len / size > UINT32_MAX)
+		return err(d, 6, "cbor: invalid typed array");
+
+	n = len / size;
+	var = ut_new_vector(type, n, d->mm);
+	vec = var->d.as_vector;
+
+	if (n > 0)
+		memcpy(vec->v, d->p, len);
+
+	if (swap) {
+		for (i = 0; i < n; i++) {
+			if (size == sizeof(uint32_t))
+				((uint32_t *) vec->v)[i] = __builtin_bswap32(((uint32_t *) vec->v)[i]);
+			else
+				((uint64_t *) vec->v)[i] = __builtin_bswap64(((uint64_t *) vec->v)[i]);
+		}
+	}
+
+	vec->n = n;
+	d->p += len;
+	return var;
+}
+
+static ut *decode_tag(struct dec *d, uint64_t tag)
+{
+	enum ut_vtype type = 0;
+	ut *rv;
+
+	switch (tag) {
+		case TAG_UINT32:
+		case TAG_UINT32 + TAG_LE:
+			type = UTV_UINT32;
+			break;
+		case TAG_INT64:
+		case TAG_INT64 + TAG_LE:
+			type = UTV_INT64;
+			break;
+		case TAG_FLOAT64:
+		case TAG_FLOAT64 + TAG_LE:
+			type = UTV_DOUBLE;
+			break;
+	}
+
+	/* typed array in a definite byte string */
+	if (type && have(d, 1) && (*d->p >> 5) == CBOR_BYTES && (*d->p & 31) != CBOR_INDEF)
+		return decode_vector(d, type, (tag & TAG_LE) != TAG_HOST);
+
+	/* other tags: just the tagged value - but tags can nest, so watch the depth */
+	if (++d->depth > CBOR_MAX_DEPTH)
+		return err(d, 4, "cbor: data too deep");
+
+	rv = decode_value(d);
+	d->depth--;
+	return rv;
+}
+
+/** Convert IEEE 754 half precision float, as in RFC 8949 appendix D */
+static double half_to_double(uint16_t h)
+{
+	int e = (h >> 10) & 0x1f, m = h & 0x3ff;
+	double v;
+
+	if (e == 0)
+		v = ldexp(m, -24);
+	else if (e != 31)
+		v = ldexp(m + 1024, e - 25);
+	else
+		v = m ? NAN : INFINITY;
+
+	return (h & 0x8000) ? -v : v;
+}
+
+static ut *decode_simple(struct dec *d, int info, uint64_t val)
+{
+	uint32_t u32;
+	float f;
+	double v;
+
+	switch (info) {
+		case 20:
+			return ut_new_bool(false, d->mm);
+		case 21:
+			return ut_new_bool(true, d->mm);
+		case 22:
+		case 23: /* undefined */
+			return ut_new_null(d->mm);
+		case 25:
+			return ut_new_double(half_to_double(val), d->mm);
+		case 26:
+			u32 = val;
+			memcpy(&f, &u32, 4);
+			return ut_new_double(f, d->mm);
+		case 27:
+			memcpy(&v, &val, 8);
+			return ut_new_double(v, d->mm);
+		case CBOR_INDEF:
+			return err(d, 7, "cbor: unexpected break");
+		default:
+			return err(d, 8, "cbor: unsupported simple value");
+	}
+}
+
+static ut *decode_value(struct dec *d)
+{
+	uint64_t val;
+	int mt, info;
+	ut *rv;
+
+	rv = read_head(d, &mt, &info, &val);
+	if (rv) return rv;
+
+	if (info == CBOR_INDEF && (mt == CBOR_UINT || mt == CBOR_NEGINT || mt == CBOR_TAG))
+		return err(d, 2, "cbor: reserved additional information");
+
+	switch (mt) {
+		case CBOR_UINT:
+			return new_uint(d, val);
+		case CBOR_NEGINT:
+			if (val <= INT_MAX)
+				return ut_new_int(-1 - (int) val, d->mm);
+			else if (val <= INT64_MAX)
+				return ut_new_int64(-1 - (int64_t) val, d->mm);
+			else
+				return ut_new_double(-1.0 - (double) val, d->mm);
+		case CBOR_BYTES:
+		case CBOR_TEXT:
+			return decode_string(d, mt, info, val);
+		case CBOR_ARRAY:
+			return decode_array(d, info == CBOR_INDEF, val);
+		case CBOR_MAP:
+			return decode_map(d, info == CBOR_INDEF, val);
+		case CBOR_TAG:
+			return decode_tag(d, val);
+		default:
+			return decode_simple(d, info, val);
+	}
+}
+
+ut *cbor_decode(const void *buf, size_t len, size_t *used, int flags, void *mm)
+{
+	struct dec d = { buf, buf, (const uint8_t *) buf + len, flags, 0, mm };
+	ut *rv;
+
+	rv = decode_value(&d);
+	if (!ut_ok(rv))
+		return rv;
+
+	if (used)
+		*used = d.p - d.start;
+	else if (d.p != d.end)
+		return err(&d, 9, "cbor: data after value");
+
+	return rv;
+}
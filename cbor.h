@@ -0,0 +1,90 @@
+/*
+ * cbor - binary encoding of unitype values
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CBOR_H_
+#define _CBOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "xstr.h"
+#include "unitype.h"
+
+/**
+ * @file cbor.h
+ * Encoder and decoder of CBOR (RFC 8949), for passing ut values between programs faster than as
+ * JSON text: numbers are stored in binary, and strings are prefixed with their length, so neither
+ * need formatting, escaping nor parsing.
+ *
+ * Types map as follows:
+ *  - T_INT, T_UINT, T_INT64, T_UINT64: integers; decoded as T_INT if they fit in an int, else as
+ *    T_INT64, or T_UINT64 if above INT64_MAX
+ *  - T_DOUBLE: float, in 4 bytes if that does not lose precision, else in 8 bytes
+ *  - T_STRING: text string; T_BYTES: byte string - not base64 text as in JSON
+ *  - T_LIST, T_ARRAY: array; decoded as T_LIST, or T_ARRAY with CBOR_COMPACT
+ *  - T_VECTOR: typed array of RFC 8746, ie. tagged byte string with the raw C array
+ *  - T_HASH: map with text string keys
+ *  - T_BOOL, T_NULL: simple values; T_PTR is encoded as null
+ *  - T_ERR: map of code, message and data, as in JSON
+ *
+ * The decoder also accepts indefinite-length items and half-precision floats, and ignores tags
+ * it does not know.
+ */
+
+/** Max nesting of arrays and maps in cbor_decode() */
+#define CBOR_MAX_DEPTH 50
+
+/** Size of buffer for cbor_write_fd() */
+#define CBOR_WRITE_BUF 65536
+
+/** Flags of cbor_decode() */
+enum cbor_flags {
+	/** Make T_BYTES reference the input instead of copying it - the input must then outlive
+	 * the result, see ut_new_bytes_ref(). Text strings are still copied: T_STRING values are
+	 * \0-terminated C strings for ut_char() and the like, and text in CBOR is not terminated -
+	 * the byte after it already belongs to the next item. */
+	CBOR_REF = 0x01,
+
+	/** Decode arrays as T_ARRAY instead of T_LIST */
+	CBOR_COMPACT = 0x02,
+};
+
+/** Append encoding of var to xs */
+void cbor_append(xstr *xs, ut *var);
+
+/** Encode var into new xstr in mm
+ * @note result is binary: use its length, not strlen() */
+xstr *cbor_encode(ut *var, void *mm);
+
+/** Write encoding of var to file descriptor, in pieces of CBOR_WRITE_BUF bytes
+ * @param mm     memory for the buffer
+ * @retval -1    write error, see errno
+ * @return       number of bytes written */
+ssize_t cbor_write_fd(ut *var, int fd, void *mm);
+
+/** Decode one value from len bytes at buf
+ * @param used   if not NULL, set to number of bytes taken by the value - which may be followed by
+ *               more data, eg. the next value; if NULL, data after the value is an error
+ * @param flags  CBOR_* flags
+ * @return       value, or error object with "i=<offset>" data */
+ut *cbor_decode(const void *buf, size_t len, size_t *used, int flags, void *mm);
+
+#endif /* _CBOR_H_ */
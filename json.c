@@ -10,7 +10,9 @@
 
 #include <ctype.h>
 #include <string.h>
+#include <limits.h>
 #include <math.h>
+#include <unistd.h>
 
 #include "lib.h"
 
@@ -32,27 +34,92 @@
 
 #define IS_LOOSE_KEYCHAR(c) (isalnum(c) || c == '-' || c == '_')
 
+static ut *parse_value(json *json);
 static ut *parse_array(json *json);
 static ut *parse_object(json *json);
+static ut *skip_value(json *json);
 
-static char skipws(json *json)
+/** Bytes of text indexed at once - keeps the index small and in cache */
+#define INDEX_WINDOW 16384
+
+/** Start indexing text, if it is long enough */
+static void index_start(json *json)
 {
-	char c;
+	json->idx = NULL;
+	if (!json->index_min || json->loose)
+		return;
+
+	json->len = strlen(json->txt);
+	if (json->len < json->index_min || json->len > INT_MAX)
+		return;
+
+	json->idx = mmatic_alloc(json, (INDEX_WINDOW + 64) * sizeof(uint32_t));
+	memset(&json->st, 0, sizeof json->st);
+	json->indexed = 0;
+	json->nidx = 0;
+	json->k = 0;
+}
 
-	while ((c = GETC())) {
-		switch (c) {
-			case ' ':
-			case '\f':
-			case '\n':
-			case '\r':
-			case '\t':
-			case '\v':
-				continue;
+static void index_stop(json *json)
+{
+	if (json->idx) {
+		mmatic_free(json->idx);
+		json->idx = NULL;
+	}
+}
+
+/** Index next window of text
+ * @retval false  whole text is indexed */
+static bool index_more(json *json)
+{
+	size_t n;
+
+	if (json->indexed >= json->len)
+		return false;
+
+	n = MIN(INDEX_WINDOW, json->len - json->indexed);
+	json->nidx = pjf_scan_index(&json->st, json->txt + json->indexed, n, json->indexed, json->idx);
+	json->indexed += n;
+	json->k = 0;
+	return true;
+}
+
+/** Return position of first token at pos or later, or of the trailing \0 */
+static size_t index_next(json *json, size_t pos)
+{
+	do {
+		/* parser only goes forward, so tokens before pos are never needed again */
+		for (; json->k < json->nidx; json->k++) {
+			if (json->idx[json->k] >= pos)
+				return json->idx[json->k];
 		}
-		break;
+	} while (index_more(json));
+
+	return json->len;
+}
+
+/** Find end of plain run in string, as pjf_scan_str() does */
+static const char *scan_str(json *json, const char *s)
+{
+	if (json->idx)
+		return json->txt + index_next(json, s - json->txt);
+	else
+		return pjf_scan_str(s);
+}
+
+static char skipws(json *json)
+{
+	const char *p = json->txt + json->i;
+
+	/* most tokens are separated by at most one space - not worth a vector scan */
+	if (PJF_IS_WS(p[0])) {
+		p++;
+		if (PJF_IS_WS(p[0]))
+			p = json->idx ? json->txt + index_next(json, p - json->txt) : pjf_scan_ws(p);
 	}
 
-	return c;
+	json->i = p - json->txt + 1;
+	return *p;
 }
 
 static ut *err(json *json, int code, const char *msg)
@@ -64,11 +131,14 @@ static ut *err(json *json, int code, const char *msg)
 		json);
 }
 
-static ut *parse_string(json *json)
+/** Read string into str
+ * @retval NULL   success
+ * @return        error */
+static ut *read_string(json *json, xstr *str)
 {
 	bool loose = 0;
 	char c, l1, l2, l3, l4;
-	xstr *str = xstr_create("", json);
+	const char *start, *end;
 
 	c = SKIPWS();
 	if (c != '"') {
@@ -80,8 +150,18 @@ static ut *parse_string(json *json)
 		}
 	}
 
-	while ((c = GETC())) {
-		if (c == '"') {
+	while (1) {
+		/* copy plain characters in runs */
+		if (!loose) {
+			start = json->txt + json->i;
+			end = scan_str(json, start);
+			xstr_append_size(str, start, end - start);
+			json->i += end - start;
+		}
+
+		if (!(c = GETC())) {
+			break;
+		} else if (c == '"') {
 			break;
 		} else if (loose && !IS_LOOSE_KEYCHAR(c)) {
 			UNGETC();
@@ -100,6 +180,12 @@ static ut *parse_string(json *json)
 				case 'r': c = '\r'; break;
 				case 't': c = '\t'; break;
 				case 'u': /* \uHHHH */
+					/* four hex digits - so it never swallows end of string, as pjf_scan_index() wouldn't */
+					for (end = json->txt + json->i; end < json->txt + json->i + 4; end++) {
+						if (!isxdigit((unsigned char) *end))
+							return err(json, 23, "string: incomplete \\u escape");
+					}
+
 					l1 = GETC();
 					l2 = GETC();
 					l3 = GETC();
@@ -121,72 +207,127 @@ static ut *parse_string(json *json)
 	if (c != '"')
 		return err(json, 11, "string: expected \" at the end");
 
+	return NULL;
+}
+
+static ut *parse_string(json *json)
+{
+	xstr *str = xstr_create("", json);
+	ut *rv;
+
+	rv = read_string(json, str);
+	if (rv) return rv;
+
 	return ut_new_xstr(str, json);
 }
 
-static ut *parse_number(json *json)
+/** Parse object key, as a slice of source text if it needs no unescaping
+ * @retval NULL   success, key stored in *key
+ * @return        error */
+static ut *parse_key(json *json, xstr_view *key)
 {
-	unsigned long long ival = 0, expo = 0;
-	double frac = 0.0, fracshft = 10.0;
-	int sign = 1, signexpo = 1;
+	const char *start, *end;
 	char c;
-	bool dbl = 0;
+	ut *str;
 
 	c = SKIPWS();
-	if (c == '-') { sign = -1; c = GETC(); }
-	if (c == '0') { c = GETC(); goto skip; }
-
-	if (!isdigit(c))
-		return err(json, 16, "number: digit expected");
+	start = json->txt + json->i;
+
+	if (c == '"') {
+		end = scan_str(json, start);
+		if (*end == '"') {
+			*key = xsv_size(start, end - start);
+			json->i += end - start + 1;
+			return NULL;
+		}
+	} else if (json->loose) {
+		start--;
+		for (end = start; (c = *end) && IS_LOOSE_KEYCHAR(c); end++);
 
-	while (isdigit(c)) {
-		ival *= 10;
-		ival += c - '0';
-		c = GETC();
+		*key = xsv_size(start, end - start);
+		json->i = end - json->txt;
+		return NULL;
 	}
 
-skip:
-	if (c != '.') goto skipfrac;
-	else dbl = true;
+	/* escapes or errors - leave it to the full string parser */
+	UNGETC();
+	str = parse_string(json);
+	if (!ut_ok(str)) return str;
 
-	c = GETC();
-	if (!isdigit(c))
-		return err(json, 17, "number: digit expected");
+	*key = ut_view(str);
+	return NULL;
+}
 
-	while (isdigit(c)) {
-		frac += (double)(c - '0') / fracshft;
-		fracshft *= 10.0;
-		c = GETC();
+/** Number read by read_number() */
+struct number {
+	enum pjf_numtype type;  /** which field below holds it */
+	long long iv;
+	unsigned long long uv;
+	double dv;
+};
+
+/** Read number into *num
+ * Only checks syntax and finds the end of number, leaving conversion to pjf_atonum().
+ * @retval NULL   success
+ * @return        error */
+static ut *read_number(json *json, struct number *num)
+{
+	const char *start, *p;
+
+	SKIPWS();
+	start = p = json->txt + json->i - 1;
+
+	if (*p == '-') p++;
+	if (*p == '0') {
+		p++;
+	} else if (isdigit(*p)) {
+		while (isdigit(*p)) p++;
+	} else {
+		json->i = p - json->txt + 1;
+		return err(json, 16, "number: digit expected");
 	}
 
-skipfrac:
-	if (c != 'e' && c != 'E') goto skipexpo;
-	else dbl = true;
+	if (*p == '.') {
+		if (!isdigit(*++p)) {
+			json->i = p - json->txt + 1;
+			return err(json, 17, "number: digit expected");
+		}
+		while (isdigit(*p)) p++;
+	}
 
-	c = GETC();
-	if (c == '+') c = GETC();
-	else if (c == '-') { signexpo = -1; c = GETC(); }
+	if (*p == 'e' || *p == 'E') {
+		if (*++p == '+' || *p == '-') p++;
+		if (!isdigit(*p)) {
+			json->i = p - json->txt + 1;
+			return err(json, 18, "number: digit expected");
+		}
+		while (isdigit(*p)) p++;
+	}
 
-	if (!isdigit(c))
-		return err(json, 18, "number: digit expected");
+	json->i = p - json->txt;
+	num->type = pjf_atonum(start, p - start, &num->iv, &num->uv, &num->dv);
+	return NULL;
+}
 
-	while (isdigit(c)) {
-		expo *= 10;
-		expo += c - '0';
-		c = GETC();
-	}
+static ut *parse_number(json *json)
+{
+	struct number num;
+	ut *rv;
 
-skipexpo:
-	UNGETC();
+	rv = read_number(json, &num);
+	if (rv) return rv;
 
-	if (dbl)
-		return ut_new_double(
-			(sign * ((long long) ival + frac)) * pow(10.0, (double) signexpo * expo),
-			json);
-	else
-		return ut_new_int(
-			sign * ival,
-			json);
+	switch (num.type) {
+		case PJF_NUM_DOUBLE:
+			return ut_new_double(num.dv, json);
+		case PJF_NUM_UINT:
+			return ut_new_uint64(num.uv, json);
+		default:
+			if (num.iv >= INT_MIN && num.iv <= INT_MAX)
+				return ut_new_int(num.iv, json);
+			else
+				return ut_new_int64(num.iv, json);
+	}
 }
 
 static bool check_literal(json *json, const char *s)
@@ -221,6 +362,65 @@ static ut *parse_null(json *json)
 		return err(json, 14, "null: expected \"null\"");
 }
 
+/** Copy of text given to json_parse() with JSON_LAZY */
+struct json_text {
+	json *json;         /** parser of T_LAZY values */
+	uint32_t refs;      /** T_LAZY values pointing into txt, plus json_parse() while it runs */
+	char txt[];
+};
+
+static void text_unref(struct json_text *jt)
+{
+	if (--jt->refs == 0)
+		mmatic_free(jt);
+}
+
+/** Parse T_LAZY value: text of lz->data, in parser of struct json_text lz->arg */
+static ut *force_lazy(struct ut_lazy *lz)
+{
+	struct json_text *jt = lz->arg, *lztxt;
+	json *json = jt->json;
+	const char *txt = json->txt;
+	int i = json->i, depth = json->depth;
+	uint32_t *idx = json->idx;
+	ut *rv;
+
+	lztxt = json->lztxt;
+	json->lztxt = jt;
+
+	/* checked already, but only for matching brackets if the text was indexed */
+	json->txt = lz->data;
+	json->i = 0;
+	json->depth = 0;
+	json->idx = NULL;
+	rv = parse_value(json);
+
+	json->txt = txt;
+	json->i = i;
+	json->depth = depth;
+	json->idx = idx;
+	json->lztxt = lztxt;
+	return rv;
+}
+
+static void free_lazy(struct ut_lazy *lz)
+{
+	text_unref(lz->arg);
+}
+
+/** Check nested value and return it as T_LAZY */
+static ut *parse_lazy(json *json)
+{
+	int start = json->i;
+	ut *rv;
+
+	rv = skip_value(json);
+	if (rv) return rv;
+
+	json->lztxt->refs++;
+	return ut_new_lazy(force_lazy, free_lazy, json->lztxt, json->txt + start, json);
+}
+
 static ut *parse_value(json *json)
 {
 	char c;
@@ -231,8 +431,8 @@ static ut *parse_value(json *json)
 		case '0': case '1': case '2': case '3': case '4': case '5':
 		case '6': case '7': case '8': case '9': case '-':
 		          return parse_number(json);
-		case '{': return parse_object(json);
-		case '[': return parse_array(json);
+		case '{': return json->lazy && json->depth ? parse_lazy(json) : parse_object(json);
+		case '[': return json->lazy && json->depth ? parse_lazy(json) : parse_array(json);
 		case 't': return parse_true(json);
 		case 'f': return parse_false(json);
 		case 'n': return parse_null(json);
@@ -241,12 +441,86 @@ static ut *parse_value(json *json)
 	return err(json, 15, "value: encountered invalid character");
 }
 
+/** Largest integer which converts to double exactly */
+#define DOUBLE_EXACT_MAX (1LL << 53)
+
+/** True if integer v converts to double exactly */
+#define DOUBLE_EXACT(v) ((v) >= -DOUBLE_EXACT_MAX && (v) <= DOUBLE_EXACT_MAX)
+
+/** Try to parse array of numbers only into a T_VECTOR
+ * @retval NULL  not an array of numbers - json->i is left intact then */
+static ut *parse_vector(json *json)
+{
+	int start = json->i;
+	uint32_t *idx = json->idx;
+	ut *vec = NULL;
+	struct number num;
+	int64_t *iv;
+	uint32_t i, n;
+	bool dbl;
+	char c;
+
+	/* the index can't go back, so don't move it in case we fail - see index_next() */
+	json->idx = NULL;
+
+	if (SKIPWS() != '[')
+		goto fail;
+
+	do {
+		c = SKIPWS(); UNGETC();
+		if (!(c == '-' || isdigit(c)) || read_number(json, &num) || num.type == PJF_NUM_UINT)
+			goto fail;
+
+		dbl = (num.type == PJF_NUM_DOUBLE);
+
+		if (!vec) {
+			vec = ut_new_vector(dbl ? UTV_DOUBLE : UTV_INT64, 0, json);
+		} else if (dbl && utv_type(vec) == UTV_INT64) {
+			/* first fraction: convert in place, both types take 8 bytes */
+			iv = utv_int64(vec, &n);
+			for (i = 0; i < n; i++) {
+				if (!DOUBLE_EXACT(iv[i])) goto fail;
+				((double *) iv)[i] = iv[i];
+			}
+			vec->d.as_vector->type = UTV_DOUBLE;
+		} else if (!dbl && utv_type(vec) == UTV_DOUBLE && !DOUBLE_EXACT(num.iv)) {
+			goto fail;
+		}
+
+		if (dbl)
+			utv_add_double(vec, num.dv);
+		else
+			utv_add_int64(vec, num.iv);
+
+		c = SKIPWS();
+	} while (c == ',');
+
+	if (c == ']') {
+		json->idx = idx;
+		return vec;
+	}
+
+fail:
+	if (vec) ut_free(vec);
+	json->i = start;
+	json->idx = idx;
+	return NULL;
+}
+
 static ut *parse_array(json *json)
 {
-	tlist *list = tlist_create(NULL, json);
-	ut *val;
+	tlist *list = NULL;
+	ut *arr = NULL, *val;
 	char c;
 
+	if (json->vectors && (val = parse_vector(json)))
+		return val;
+
+	if (json->compact)
+		arr = ut_new_array(0, json);
+	else
+		list = tlist_create(ut_free, json);
+
 	c = SKIPWS();
 	if (c != '[')
 		return err(json, 3, "array: expected '['");
@@ -265,7 +539,10 @@ static ut *parse_array(json *json)
 		if (!(c == ',' || c == ']'))
 			return err(json, 4, "array: expected ',' or ']'");
 
-		tlist_push(list, val);
+		if (arr)
+			uta_add(arr, val);
+		else
+			tlist_push(list, val);
 
 		if (c == ',')
 			c = SKIPWS();
@@ -275,14 +552,15 @@ static ut *parse_array(json *json)
 		return err(json, 5, "array: expected ']'");
 
 	DEC_DEPTH();
-	return ut_new_uttlist(list, json);
+	return arr ? arr : ut_new_uttlist(list, json);
 }
 
 static ut *parse_object(json *json)
 {
 	char c;
-	thash *hash = thash_create(NULL, NULL, NULL, true, json);
-	ut *key, *val;
+	thash *hash = thash_create(NULL, NULL, ut_free, true, json);
+	xstr_view key;
+	ut *rv, *val;
 
 	c = SKIPWS();
 	if (c != '{')
@@ -294,8 +572,8 @@ static ut *parse_object(json *json)
 	while (c > 0 && c != '}') {
 		UNGETC();
 
-		key = parse_string(json);
-		if (!ut_ok(key)) return key;
+		rv = parse_key(json, &key);
+		if (rv) return rv;
 
 		c = SKIPWS();
 		if (c != ':' && !(json->loose && c == '='))
@@ -314,7 +592,7 @@ static ut *parse_object(json *json)
 			}
 		}
 
-		thash_set(hash, ut_char(key), val);
+		thash_set_len(hash, key.s, key.len, val);
 
 		if (c == ',')
 			c = SKIPWS();
@@ -329,9 +607,36 @@ static ut *parse_object(json *json)
 
 ut *json_parse(json *json, const char *txt)
 {
+	struct json_text *jt = NULL;
+	size_t len;
+	ut *rv;
+
+	/* T_LAZY values point into the text */
+	if (json->lazy) {
+		len = strlen(txt);
+		jt = mmatic_alloc(json, sizeof *jt + len + 1);
+		jt->json = json;
+		jt->refs = 1;
+		memcpy(jt->txt, txt, len + 1);
+
+		json->lztxt = jt;
+		txt = jt->txt;
+	}
+
 	json->txt = txt;
 	json->i = 0;
-	return parse_value(json);
+	json->depth = 0;
+
+	index_start(json);
+	rv = parse_value(json);
+	index_stop(json);
+
+	if (jt) {
+		json->lztxt = NULL;
+		text_unref(jt);
+	}
+
+	return rv;
 }
 
 json *json_create(void *mm)
@@ -342,6 +647,12 @@ json *json_create(void *mm)
 	j->i = 0;
 	j->depth = 0;
 	j->loose = false;
+	j->compact = false;
+	j->vectors = false;
+	j->lazy = false;
+	j->lztxt = NULL;
+	j->index_min = JSON_INDEX_MIN;
+	j->idx = NULL;
 
 	return j;
 }
@@ -352,6 +663,18 @@ bool json_setopt(json *j, enum json_option o, long v)
 		case JSON_LOOSE:
 			j->loose = (bool) v;
 			break;
+		case JSON_COMPACT:
+			j->compact = (bool) v;
+			break;
+		case JSON_VECTORS:
+			j->vectors = (bool) v;
+			break;
+		case JSON_INDEX:
+			j->index_min = (v > 0) ? v : 0;
+			break;
+		case JSON_LAZY:
+			j->lazy = (bool) v;
+			break;
 		default:
 			return false;
 	}
@@ -359,111 +682,1000 @@ bool json_setopt(json *j, enum json_option o, long v)
 	return true;
 }
 
+/** Return pointer to the first character in s which needs escaping, or to the trailing \0 */
+static const char *escape_next(const char *s)
+{
+	/* skip runs of plain characters at once - other control characters are left as they are */
+	for (;; s++) {
+		s = pjf_scan_str(s);
+		switch (*s) {
+			case '\0':
+			case '\\':
+			case '"':
+			case '\b':
+			case '\f':
+			case '\n':
+			case '\r':
+			case '\t':
+				return s;
+		}
+	}
+}
+
+/** Write escape sequence for character at s into out
+ * @return length of the sequence */
+static int escape_seq(const char *s, char *out)
+{
+	out[0] = '\\';
+
+	switch (*s) {
+		case '\\':
+			if (s[1] == 'u') return 1;  /* copy \uHHHH verbatim */
+			out[1] = '\\';
+			break;
+		case '"':   out[1] = '"';   break;
+		case '\b':  out[1] = 'b';   break;
+		case '\f':  out[1] = 'f';   break;
+		case '\n':  out[1] = 'n';   break;
+		case '\r':  out[1] = 'r';   break;
+		case '\t':  out[1] = 't';   break;
+	}
+
+	return 2;
+}
+
 char *json_escape(json *json, const char *str)
 {
-	bool bs;
-	char c;
+	const char *e;
+	char seq[2];
 	xstr *xs = xstr_create("", json);
 
 	xstr_reserve(xs, 1.1 * strlen(str));
 
-	while ((c = *str++)) {
-		bs = true;
-		switch (c) {
-			case '\\':
-				if (*str == 'u') bs = false;  /* copy \uHHHH verbatim */
-				break;
-			case '"':               break;
-			case '\b':  c = 'b';    break;
-			case '\f':  c = 'f';    break;
-			case '\n':  c = 'n';    break;
-			case '\r':  c = 'r';    break;
-			case '\t':  c = 't';    break;
-			default:    bs = false; break;
-		}
-
-		if (bs) xstr_append_char(xs, '\\');
-		xstr_append_char(xs, c);
+	for (;; str = e + 1) {
+		e = escape_next(str);
+		xstr_append_size(xs, str, e - str);
+		if (!*e) break;
+		xstr_append_size(xs, seq, escape_seq(e, seq));
 	}
 
 	return xstr_string(xs);
 }
 
-char *json_print(json *json, ut *var)
+/** Append escaped str to rope, referencing runs of safe characters instead of copying them */
+static void rope_escape(rope *r, const char *str)
 {
-	void *mm = json;
-	char *k, *str;
+	const char *e;
+	char seq[2];
+
+	for (;; str = e + 1) {
+		e = escape_next(str);
+		rope_borrow(r, str, e - str);
+		if (!*e) break;
+		rope_append_size(r, seq, escape_seq(e, seq));
+	}
+}
+
+static void rope_quoted(rope *r, const char *str)
+{
+	rope_append_char(r, '"');
+	rope_escape(r, str);
+	rope_append_char(r, '"');
+}
+
+/** Bytes encoded in base64 at once - gives 1024 characters */
+#define BASE64_CHUNK 768
+
+/** Encode len bytes at p in base64 (RFC 4648), with padding
+ * @param out  room for 4 * ((len + 2) / 3) characters
+ * @return     number of characters written */
+static size_t base64_encode(const unsigned char *p, size_t len, char *out)
+{
+	static const char d[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	size_t i = 0, n = 0;
+	uint32_t v;
+
+	for (; i + 3 <= len; i += 3) {
+		v = p[i] << 16 | p[i+1] << 8 | p[i+2];
+		out[n++] = d[v >> 18];
+		out[n++] = d[(v >> 12) & 63];
+		out[n++] = d[(v >> 6) & 63];
+		out[n++] = d[v & 63];
+	}
+
+	if (i < len) {
+		v = p[i] << 16 | (i + 1 < len ? p[i+1] << 8 : 0);
+		out[n++] = d[v >> 18];
+		out[n++] = d[(v >> 12) & 63];
+		out[n++] = (i + 1 < len) ? d[(v >> 6) & 63] : '=';
+		out[n++] = '=';
+	}
+
+	return n;
+}
+
+/** Append len bytes at s to rope as a quoted base64 string */
+static void rope_base64(rope *r, const char *s, size_t len)
+{
+	char buf[BASE64_CHUNK / 3 * 4];
+	size_t i;
+
+	rope_append_char(r, '"');
+	for (i = 0; i < len; i += BASE64_CHUNK)
+		rope_append_size(r, buf, base64_encode((const unsigned char *) s + i, MIN(len - i, BASE64_CHUNK), buf));
+	rope_append_char(r, '"');
+}
+
+/** Print double so that it reads back as the same double
+ * @param buf  room for PJF_NUMBUF + 2 characters
+ * @return     length of text in buf */
+static int format_double(double v, char *buf)
+{
+	int len;
+
+	/* JSON has no NaN nor infinity */
+	if (!isfinite(v)) {
+		memcpy(buf, "null", 4);
+		return 4;
+	}
+
+	/* keep integral values as doubles */
+	len = pjf_dtoa(v, buf);
+	if (!strpbrk(buf, ".e")) {
+		memcpy(buf + len, ".0", 2);
+		len += 2;
+	}
+
+	return len;
+}
+
+static void rope_double(rope *r, double v)
+{
+	char buf[PJF_NUMBUF + 2];
+	rope_append_size(r, buf, format_double(v, buf));
+}
+
+void json_print_rope(json *json, ut *var, rope *r)
+{
+	struct ut_vector *vec;
+	char buf[64], *k;
+	bool first;
+	uint32_t i;
 	ut *el;
-	xstr *xs;
 
-	switch (var->type) {
+	switch (ut_type(var)) {
 		case T_STRING:
-			str = mmatic_sprintf(mm, "\"%s\"",
-				json_escape(json, xstr_string(var->d.as_xstr)));
+			rope_quoted(r, xstr_string(var->d.as_xstr));
+			break;
+
+		case T_BYTES:
+			rope_base64(r, var->d.as_bytes->s, var->d.as_bytes->len);
 			break;
 
 		case T_INT:
-			str = mmatic_sprintf(mm, "%d", var->d.as_int);
+			rope_append_size(r, buf, pjf_itoa(var->d.as_int, buf));
+			break;
+
+		case T_UINT:
+			rope_append_size(r, buf, pjf_utoa(var->d.as_uint, buf));
+			break;
+
+		case T_INT64:
+			rope_append_size(r, buf, pjf_itoa(var->d.as_int64, buf));
+			break;
+
+		case T_UINT64:
+			rope_append_size(r, buf, pjf_utoa(var->d.as_uint64, buf));
 			break;
 
 		case T_DOUBLE:
-			str = mmatic_sprintf(mm, "%g", var->d.as_double);
+			rope_double(r, var->d.as_double);
 			break;
 
 		case T_LIST:
-			xs = MMXSTR_CREATE("[ ");
+			rope_append_size(r, "[ ", 2);
 
+			first = true;
 			tlist_iter_loop(var->d.as_tlist, el) {
-				xstr_append(xs, json_print(json, el));
-				xstr_append(xs, ", ");
+				if (!first) rope_append_size(r, ", ", 2);
+				first = false;
+
+				json_print_rope(json, el, r);
 			}
-			if (xstr_length(xs) > 2) xstr_cut(xs, 2);
-			xstr_append(xs, " ]");
 
-			str = xstr_string(xs);
+			rope_append_size(r, " ]", 2);
+			break;
+
+		case T_ARRAY:
+			rope_append_size(r, "[ ", 2);
+
+			uta_iter_loop(var, i, el) {
+				if (i > 0) rope_append_size(r, ", ", 2);
+				json_print_rope(json, el, r);
+			}
+
+			rope_append_size(r, " ]", 2);
+			break;
+
+		case T_VECTOR:
+			rope_append_size(r, "[ ", 2);
+
+			vec = var->d.as_vector;
+			for (i = 0; i < vec->n; i++) {
+				if (i > 0) rope_append_size(r, ", ", 2);
+
+				switch (vec->type) {
+					case UTV_INT64:
+						rope_append_size(r, buf, pjf_itoa(((int64_t *) vec->v)[i], buf));
+						break;
+					case UTV_UINT32:
+						rope_append_size(r, buf, pjf_utoa(((uint32_t *) vec->v)[i], buf));
+						break;
+					case UTV_DOUBLE:
+						rope_double(r, ((double *) vec->v)[i]);
+						break;
+				}
+			}
+
+			rope_append_size(r, " ]", 2);
 			break;
 
 		case T_HASH:
-			xs = MMXSTR_CREATE("{ ");
+			rope_append_size(r, "{ ", 2);
 
+			first = true;
 			thash_iter_loop(var->d.as_thash, k, el) {
-				xstr_append_char(xs, '"');
-				xstr_append(xs, k);
-				xstr_append(xs, "\": ");
+				if (!first) rope_append_size(r, ", ", 2);
+				first = false;
 
-				xstr_append(xs, json_print(json, el));
-				xstr_append(xs, ", ");
+				rope_quoted(r, k);
+				rope_append_size(r, ": ", 2);
+				json_print_rope(json, el, r);
 			}
-			if (xstr_length(xs) > 2) xstr_cut(xs, 2);
-			xstr_append(xs, " }");
 
-			str = xstr_string(xs);
+			rope_append_size(r, " }", 2);
 			break;
 
 		case T_BOOL:
-			str = var->d.as_bool ? "true" : "false";
+			rope_append(r, var->d.as_bool ? "true" : "false");
 			break;
 
 		case T_NULL:
-			str = "null";
+			rope_append_size(r, "null", 4);
 			break;
 
 		case T_ERR:
-			if (var->d.as_err->data)
-				str = mmatic_sprintf(mm, "{ \"code\": %d, \"message\": \"%s\", \"data\": \"%s\" }",
-					var->d.as_err->code,
-					json_escape(json, var->d.as_err->msg),
-					json_escape(json, var->d.as_err->data));
-			else
-				str = mmatic_sprintf(mm, "{ \"code\": %d, \"message\": \"%s\" }",
-					var->d.as_err->code,
-					json_escape(json, var->d.as_err->msg));
+			rope_append_size(r, buf, snprintf(buf, sizeof buf, "{ \"code\": %d, \"message\": ",
+				var->d.as_err->code));
+			rope_quoted(r, var->d.as_err->msg);
+
+			if (var->d.as_err->data) {
+				rope_append(r, ", \"data\": ");
+				rope_quoted(r, var->d.as_err->data);
+			}
+
+			rope_append_size(r, " }", 2);
 			break;
 
 		default:
-			str = "";
 			break;
 	}
+}
+
+char *json_print(json *json, ut *var)
+{
+	rope *r = rope_create(json);
+	char *str;
+
+	json_print_rope(json, var, r);
+	str = rope_string(r, json);
+	rope_free(r);
+
+	return str;
+}
+
+/****************************************************************/
+
+/** Array, list or object being written by json_write_fd() and json_write_file() */
+struct wframe {
+	ut *var;            /** the container */
+	uint32_t i;         /** next T_ARRAY index or thash bucket */
+	void *el;           /** next tlist_el, or current thash_el */
+	bool first;         /** nothing written inside yet */
+};
+
+/** State of json_write_fd() and json_write_file() */
+struct writer {
+	char *buf;          /** output buffer, JSON_WRITE_BUF bytes */
+	size_t n;           /** bytes in buf */
+	int fd;             /** where to write, if fp is NULL */
+	FILE *fp;           /** where to write */
+	ssize_t total;      /** bytes written so far, -1 after an error */
+
+	struct wframe *st;  /** containers being written, innermost last */
+	uint32_t depth;     /** number of frames in st */
+	uint32_t a;         /** allocated frames */
+};
+
+static void w_flush(struct writer *w)
+{
+	size_t done = 0;
+	ssize_t rc;
+
+	if (w->total < 0 || w->n == 0) {
+		w->n = 0;
+		return;
+	}
+
+	if (w->fp) {
+		if (fwrite(w->buf, 1, w->n, w->fp) != w->n)
+			w->total = -1;
+	} else {
+		while (done < w->n) {
+			rc = write(w->fd, w->buf + done, w->n - done);
+			if (rc < 0) {
+				if (errno == EINTR) continue;
+				w->total = -1;
+				break;
+			}
+			done += rc;
+		}
+	}
+
+	if (w->total >= 0)
+		w->total += w->n;
+	w->n = 0;
+}
+
+static void w_put(struct writer *w, const char *s, size_t len)
+{
+	size_t k;
+
+	while (len > JSON_WRITE_BUF - w->n) {
+		k = JSON_WRITE_BUF - w->n;
+		memcpy(w->buf + w->n, s, k);
+		w->n += k;
+		s += k;
+		len -= k;
+		w_flush(w);
+	}
+
+	memcpy(w->buf + w->n, s, len);
+	w->n += len;
+}
+
+static void w_quoted(struct writer *w, const char *str)
+{
+	const char *e;
+	char seq[2];
+
+	w_put(w, "\"", 1);
+	for (;; str = e + 1) {
+		e = escape_next(str);
+		w_put(w, str, e - str);
+		if (!*e) break;
+		w_put(w, seq, escape_seq(e, seq));
+	}
+	w_put(w, "\"", 1);
+}
+
+static void w_base64(struct writer *w, const char *s, size_t len)
+{
+	char buf[BASE64_CHUNK / 3 * 4];
+	size_t i;
+
+	w_put(w, "\"", 1);
+	for (i = 0; i < len; i += BASE64_CHUNK)
+		w_put(w, buf, base64_encode((const unsigned char *) s + i, MIN(len - i, BASE64_CHUNK), buf));
+	w_put(w, "\"", 1);
+}
+
+static void w_vector(struct writer *w, struct ut_vector *vec)
+{
+	char buf[PJF_NUMBUF + 2];
+	uint32_t i;
+
+	w_put(w, "[ ", 2);
+	for (i = 0; i < vec->n; i++) {
+		if (i > 0) w_put(w, ", ", 2);
+		switch (vec->type) {
+			case UTV_INT64:
+				w_put(w, buf, pjf_itoa(((int64_t *) vec->v)[i], buf));
+				break;
+			case UTV_UINT32:
+				w_put(w, buf, pjf_utoa(((uint32_t *) vec->v)[i], buf));
+				break;
+			case UTV_DOUBLE:
+				w_put(w, buf, format_double(((double *) vec->v)[i], buf));
+				break;
+		}
+	}
+	w_put(w, " ]", 2);
+}
+
+/** Write var - or if it is a list, array or object: its opening bracket, and start a frame for it */
+static void w_value(struct writer *w, ut *var)
+{
+	struct wframe *f;
+	char buf[64];
+
+	switch (ut_type(var)) {
+		case T_STRING:
+			w_quoted(w, xstr_string(var->d.as_xstr));
+			break;
+		case T_BYTES:
+			w_base64(w, var->d.as_bytes->s, var->d.as_bytes->len);
+			break;
+		case T_INT:
+			w_put(w, buf, pjf_itoa(var->d.as_int, buf));
+			break;
+		case T_UINT:
+			w_put(w, buf, pjf_utoa(var->d.as_uint, buf));
+			break;
+		case T_INT64:
+			w_put(w, buf, pjf_itoa(var->d.as_int64, buf));
+			break;
+		case T_UINT64:
+			w_put(w, buf, pjf_utoa(var->d.as_uint64, buf));
+			break;
+		case T_DOUBLE:
+			w_put(w, buf, format_double(var->d.as_double, buf));
+			break;
+		case T_VECTOR:
+			w_vector(w, var->d.as_vector);
+			break;
+		case T_LIST:
+		case T_ARRAY:
+		case T_HASH:
+			w_put(w, var->type == T_HASH ? "{ " : "[ ", 2);
+
+			if (w->depth == w->a) {
+				w->a *= 2;
+				w->st = mmatic_resize(w->st, w->a * sizeof(struct wframe));
+			}
+
+			f = &w->st[w->depth++];
+			f->var = var;
+			f->i = 0;
+			f->el = (var->type == T_LIST) ? var->d.as_tlist->head : NULL;
+			f->first = true;
+			break;
+		case T_BOOL:
+			if (var->d.as_bool)
+				w_put(w, "true", 4);
+			else
+				w_put(w, "false", 5);
+			break;
+		case T_NULL:
+			w_put(w, "null", 4);
+			break;
+		case T_ERR:
+			w_put(w, buf, snprintf(buf, sizeof buf, "{ \"code\": %d, \"message\": ", var->d.as_err->code));
+			w_quoted(w, var->d.as_err->msg);
+			if (var->d.as_err->data) {
+				w_put(w, ", \"data\": ", 10);
+				w_quoted(w, var->d.as_err->data);
+			}
+			w_put(w, " }", 2);
+			break;
+		default:
+			break;
+	}
+}
+
+/** Return next child of container in f, in the same order as json_print() writes them
+ * Walks the container by itself, leaving iterators of its tlist or thash alone.
+ * @param key    set to key of the child, for T_HASH
+ * @retval NULL  no more children */
+static ut *w_child(struct wframe *f, const char **key)
+{
+	tlist_el *le;
+	thash_el *he;
+	thash *h;
+
+	switch (f->var->type) {
+		case T_LIST:
+			if (!(le = f->el)) return NULL;
+			f->el = le->next;
+			return le->val;
+		case T_ARRAY:
+			return uta_get(f->var, f->i++);
+		case T_HASH:
+			h = f->var->d.as_thash;
+			he = f->el ? ((thash_el *) f->el)->next : NULL;
+			while (!he && f->i < h->size)
+				he = h->tbl[f->i++];
+			if (!he) return NULL;
+
+			f->el = he;
+			*key = he->key;
+			return he->val;
+		default:
+			return NULL;
+	}
+}
+
+/** Write var, walking the tree with own stack instead of recursion */
+static ssize_t w_write(json *json, struct writer *w, ut *var)
+{
+	struct wframe *f;
+	const char *key;
+	ut *el;
+
+	w->buf = mmatic_alloc(json, JSON_WRITE_BUF);
+	w->n = 0;
+	w->total = 0;
+	w->a = 16;
+	w->st = mmatic_alloc(json, w->a * sizeof(struct wframe));
+	w->depth = 0;
+
+	w_value(w, var);
+	while (w->depth > 0 && w->total >= 0) {
+		f = &w->st[w->depth - 1];
+		key = NULL;
+
+		el = w_child(f, &key);
+		if (!el) {
+			w_put(w, f->var->type == T_HASH ? " }" : " ]", 2);
+			w->depth--;
+			continue;
+		}
+
+		if (!f->first) w_put(w, ", ", 2);
+		f->first = false;
+
+		if (key) {
+			w_quoted(w, key);
+			w_put(w, ": ", 2);
+		}
+
+		w_value(w, el);
+	}
+	w_flush(w);
+
+	mmatic_free(w->st);
+	mmatic_free(w->buf);
+	return w->total;
+}
+
+ssize_t json_write_fd(json *json, ut *var, int fd)
+{
+	struct writer w = { .fd = fd };
+	return w_write(json, &w, var);
+}
+
+ssize_t json_write_file(json *json, ut *var, FILE *fp)
+{
+	struct writer w = { .fp = fp };
+	return w_write(json, &w, var);
+}
+
+/****************************************************************/
+
+/** Skip a string without copying it, checking it as read_string() does */
+static ut *skip_string(json *json)
+{
+	const char *p, *end;
+
+	if (SKIPWS() != '"')
+		return err(json, 8, "string: expected \" at the start");
+
+	for (p = json->txt + json->i;; p++) {
+		p = scan_str(json, p);
+		if (*p != '\\') break;
+
+		json->i = p - json->txt + 2;
+		switch (*++p) {
+			case 'b': case 'f': case 'n': case 'r': case 't':
+			case '\\': case '/': case '"':
+				break;
+			case 'u':
+				for (end = p + 1; end < p + 5; end++) {
+					if (!isxdigit((unsigned char) *end))
+						return err(json, 23, "string: incomplete \\u escape");
+				}
+				p += 4;
+				break;
+			default:
+				return err(json, 10, "string: illegal escape character");
+		}
+	}
+
+	json->i = p - json->txt + 1;
+	if (*p > 0 && *p <= 31)
+		return err(json, 9, "string: control characters not allowed");
+	else if (*p != '"')
+		return err(json, 11, "string: expected \" at the end");
+
+	return NULL;
+}
+
+/** Change of depth for each character, or 2 for control characters */
+static const signed char bracket_depth[256] = {
+	0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	['{'] = 1, ['['] = 1,
+	['}'] = -1, [']'] = -1,
+};
+
+/** Skip array or object by matching brackets in the index
+ * Checks strings for control characters, but not the syntax of values in between. */
+static ut *skip_container(json *json)
+{
+	int depth = 0, max = 50 - json->depth, d;
+	size_t pos;
+
+	/* walk the index itself, without a branch per kind of token */
+	index_next(json, json->i);
+	do {
+		for (; json->k < json->nidx; json->k++) {
+			pos = json->idx[json->k];
+			d = bracket_depth[(unsigned char) json->txt[pos]];
+			if (d == 2) {
+				json->i = pos;
+				return err(json, 11, "string: expected \" at the end");
+			}
+
+			depth += d;
+			if ((unsigned int) (depth - 1) >= (unsigned int) max) {
+				json->i = pos + 1;
+				if (depth > 0)
+					return err(json, 20, "document too deep");
+
+				json->k++;
+				return NULL;
+			}
+		}
+	} while (index_more(json));
+
+	json->i = json->len;
+	return err(json, 24, "unexpected end of text");
+}
+
+/** Skip any value without building nodes for it */
+static ut *skip_value(json *json)
+{
+	struct number num;
+	xstr_view key;
+	char c;
+	ut *rv;
+
+	c = SKIPWS(); UNGETC();
+
+	if (json->idx && (c == '[' || c == '{'))
+		return skip_container(json);
+
+	switch (c) {
+		case '"':
+			return skip_string(json);
+		case '0': case '1': case '2': case '3': case '4': case '5':
+		case '6': case '7': case '8': case '9': case '-':
+			return read_number(json, &num);
+		case 't':
+			return check_literal(json, "true") ? NULL : err(json, 12, "true: expected \"true\"");
+		case 'f':
+			return check_literal(json, "false") ? NULL : err(json, 13, "false: expected \"false\"");
+		case 'n':
+			return check_literal(json, "null") ? NULL : err(json, 14, "null: expected \"null\"");
+		case '[':
+			SKIPWS();
+			INC_DEPTH();
+
+			c = SKIPWS();
+			while (c > 0 && c != ']') {
+				UNGETC();
+
+				rv = skip_value(json);
+				if (rv) return rv;
+
+				c = SKIPWS();
+				if (!(c == ',' || c == ']'))
+					return err(json, 4, "array: expected ',' or ']'");
+
+				if (c == ',')
+					c = SKIPWS();
+			}
+
+			if (c != ']')
+				return err(json, 5, "array: expected ']'");
+
+			DEC_DEPTH();
+			return NULL;
+		case '{':
+			SKIPWS();
+			INC_DEPTH();
+
+			c = SKIPWS();
+			while (c > 0 && c != '}') {
+				UNGETC();
+
+				rv = parse_key(json, &key);
+				if (rv) return rv;
+
+				c = SKIPWS();
+				if (c != ':' && !(json->loose && c == '='))
+					return err(json, 6, "object: expected ':'");
+
+				rv = skip_value(json);
+				if (rv) return rv;
+
+				c = SKIPWS();
+				if (!(c == ',' || c == '}')) {
+					if (json->loose) {
+						UNGETC();
+						c = ',';
+					} else {
+						return err(json, 7, "object: expected ',' or '}'");
+					}
+				}
+
+				if (c == ',')
+					c = SKIPWS();
+			}
+
+			if (c != '}')
+				return err(json, 19, "object: expected '}'");
+
+			DEC_DEPTH();
+			return NULL;
+	}
+
+	return err(json, 15, "value: encountered invalid character");
+}
+
+/** Find field for key
+ * @retval NULL   key is not described */
+static const json_field *find_field(const json_field *fields, xstr_view key)
+{
+	for (; fields->name; fields++) {
+		if (fields->name[0] == key.s[0] && xsv_eq_str(key, fields->name))
+			return fields;
+	}
+
+	return NULL;
+}
+
+static ut *decode_object(json *json, const json_field *fields, void *dst);
+
+/** Decode value for field f into its member in dst */
+static ut *decode_value(json *json, const json_field *f, void *dst)
+{
+	void *m = (char *) dst + f->offset;
+	const char *start, *end;
+	struct number num;
+	xstr *str;
+	char c;
+	ut *rv;
+
+	c = SKIPWS(); UNGETC();
+
+	/* null keeps the current value */
+	if (c == 'n' && f->type != JSON_F_UT)
+		return skip_value(json);
+
+	switch (f->type) {
+		case JSON_F_BOOL:
+			if (c == 't' && check_literal(json, "true"))
+				*(bool *) m = true;
+			else if (c == 'f' && check_literal(json, "false"))
+				*(bool *) m = false;
+			else
+				break;
+			return NULL;
+
+		case JSON_F_INT:
+		case JSON_F_UINT:
+		case JSON_F_INT64:
+		case JSON_F_DOUBLE:
+			if (!(c == '-' || isdigit(c)))
+				break;
+
+			rv = read_number(json, &num);
+			if (rv) return rv;
+
+			if (f->type == JSON_F_DOUBLE) {
+				if (num.type == PJF_NUM_UINT)
+					*(double *) m = num.uv;
+				else if (num.type == PJF_NUM_INT)
+					*(double *) m = num.iv;
+				else
+					*(double *) m = num.dv;
+				return NULL;
+			}
+
+			/* integer members: no fractions, and nothing which does not fit */
+			if (num.type == PJF_NUM_UINT) {
+				break;
+			} else if (num.type == PJF_NUM_DOUBLE) {
+				if (!(num.dv >= -0x1p63 && num.dv < 0x1p63) || num.dv != trunc(num.dv))
+					break;
+				num.iv = num.dv;
+			}
+
+			if (f->type == JSON_F_INT) {
+				if (num.iv < INT_MIN || num.iv > INT_MAX)
+					break;
+				*(int *) m = num.iv;
+			} else if (f->type == JSON_F_UINT) {
+				if (num.iv < 0 || num.iv > UINT32_MAX)
+					break;
+				*(uint32_t *) m = num.iv;
+			} else {
+				*(int64_t *) m = num.iv;
+			}
+			return NULL;
+
+		case JSON_F_STRING:
+			if (c != '"')
+				break;
+
+			/* no escapes: copy straight from the source */
+			start = json->txt + json->i + 1;
+			end = scan_str(json, start);
+			if (*end == '"') {
+				*(char **) m = xsv_dup(xsv_size(start, end - start), json);
+				json->i = end - json->txt + 1;
+				return NULL;
+			}
+
+			str = xstr_create("", json);
+			rv = read_string(json, str);
+			if (rv) return rv;
+
+			*(char **) m = xstr_string(str);
+			return NULL;
+
+		case JSON_F_OBJECT:
+			if (c != '{')
+				break;
+
+			return decode_object(json, f->sub, m);
+
+		case JSON_F_UT:
+			rv = parse_value(json);
+			if (!ut_ok(rv)) return rv;
+
+			*(ut **) m = rv;
+			return NULL;
+	}
+
+	return err(json, 22, mmatic_sprintf(json, "decode: invalid value for \"%s\"", f->name));
+}
+
+static ut *decode_object(json *json, const json_field *fields, void *dst)
+{
+	const json_field *f;
+	xstr_view key;
+	char c;
+	ut *rv;
+
+	c = SKIPWS();
+	if (c != '{')
+		return err(json, 2, "object: expected '{'");
+
+	INC_DEPTH();
+
+	c = SKIPWS();
+	while (c > 0 && c != '}') {
+		UNGETC();
+
+		rv = parse_key(json, &key);
+		if (rv) return rv;
+
+		c = SKIPWS();
+		if (c != ':' && !(json->loose && c == '='))
+			return err(json, 6, "object: expected ':'");
+
+		f = key.len ? find_field(fields, key) : NULL;
+		rv = f ? decode_value(json, f, dst) : skip_value(json);
+		if (rv) return rv;
+
+		c = SKIPWS();
+		if (!(c == ',' || c == '}')) {
+			if (json->loose) {
+				UNGETC();
+				c = ',';
+			} else {
+				return err(json, 7, "object: expected ',' or '}'");
+			}
+		}
+
+		if (c == ',')
+			c = SKIPWS();
+	}
+
+	if (c != '}')
+		return err(json, 19, "object: expected '}'");
+
+	DEC_DEPTH();
+	return NULL;
+}
+
+ut *json_decode(json *json, const char *txt, const json_field *fields, void *dst)
+{
+	bool lazy = json->lazy;
+	ut *rv;
+
+	json->txt = txt;
+	json->i = 0;
+	json->depth = 0;
+
+	/* txt is not copied here, so JSON_F_UT values can't point into it */
+	json->lazy = false;
+
+	index_start(json);
+	rv = decode_object(json, fields, dst);
+	index_stop(json);
+
+	json->lazy = lazy;
+
+	return rv;
+}
+
+void json_encode_rope(json *json, const json_field *fields, const void *src, rope *r)
+{
+	const json_field *f;
+	const void *m;
+	char buf[PJF_NUMBUF];
+	char *s;
+	ut *var;
+
+	rope_append_size(r, "{ ", 2);
+
+	for (f = fields; f->name; f++) {
+		m = (const char *) src + f->offset;
+
+		if (f != fields) rope_append_size(r, ", ", 2);
+		rope_quoted(r, f->name);
+		rope_append_size(r, ": ", 2);
+
+		switch (f->type) {
+			case JSON_F_BOOL:
+				rope_append(r, *(const bool *) m ? "true" : "false");
+				break;
+			case JSON_F_INT:
+				rope_append_size(r, buf, pjf_itoa(*(const int *) m, buf));
+				break;
+			case JSON_F_UINT:
+				rope_append_size(r, buf, pjf_utoa(*(const uint32_t *) m, buf));
+				break;
+			case JSON_F_INT64:
+				rope_append_size(r, buf, pjf_itoa(*(const int64_t *) m, buf));
+				break;
+			case JSON_F_DOUBLE:
+				rope_double(r, *(const double *) m);
+				break;
+			case JSON_F_STRING:
+				s = *(char * const *) m;
+				if (s)
+					rope_quoted(r, s);
+				else
+					rope_append_size(r, "null", 4);
+				break;
+			case JSON_F_OBJECT:
+				json_encode_rope(json, f->sub, m, r);
+				break;
+			case JSON_F_UT:
+				var = *(ut * const *) m;
+				if (var)
+					json_print_rope(json, var, r);
+				else
+					rope_append_size(r, "null", 4);
+				break;
+		}
+	}
+
+	rope_append_size(r, " }", 2);
+}
+
+char *json_encode(json *json, const json_field *fields, const void *src)
+{
+	rope *r = rope_create(json);
+	char *str;
+
+	json_encode_rope(json, fields, src, r);
+	str = rope_string(r, json);
+	rope_free(r);
 
 	return str;
 }
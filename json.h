@@ -14,14 +14,48 @@
 typedef struct json {
 	int depth;          /** recurrency depth */
 	bool loose;         /** if true, be more permissive about standard strictness */
+	bool compact;       /** if true, parse arrays into T_ARRAY */
+	bool vectors;       /** if true, parse arrays of numbers into T_VECTOR */
+	bool lazy;          /** if true, parse nested arrays and objects into T_LAZY */
+	struct json_text *lztxt; /** text which new T_LAZY values point into */
 
 	const char *txt;    /** text representation */
 	int i;              /** position in txt */
+
+	size_t index_min;   /** see JSON_INDEX */
+	uint32_t *idx;      /** if not NULL, positions of tokens in current window of txt */
+	size_t nidx;        /** number of positions in idx */
+	size_t k;           /** next position in idx to look at */
+	size_t len;         /** length of txt, if indexed */
+	size_t indexed;     /** length of txt indexed so far */
+	pjf_scan_state st;  /** state of indexing */
 } json;
 
+/** Default for JSON_INDEX */
+#define JSON_INDEX_MIN 65536
+
 enum json_option {
 	/** Accept a bit invalid syntax, which is easier to write by hand */
-	JSON_LOOSE = 1
+	JSON_LOOSE = 1,
+
+	/** Parse arrays into compact T_ARRAY values instead of lists of ut nodes */
+	JSON_COMPACT,
+
+	/** Parse non-empty arrays of numbers only into T_VECTOR values: of int64 if all are integers,
+	 * else of doubles (unless some integer would lose precision) */
+	JSON_VECTORS,
+
+	/** In json_parse() and json_decode(), find tokens of texts at least v bytes long first, with
+	 * pjf_scan_index(), then jump between them instead of looking at every byte of whitespace,
+	 * strings and skipped values; 0 disables. Not used for JSON_LOOSE. Note skipped arrays and
+	 * objects - unknown fields and JSON_LAZY values - are then only checked for matching brackets
+	 * and terminated strings. */
+	JSON_INDEX,
+
+	/** In json_parse(), only check nested arrays and objects, and return them as T_LAZY values -
+	 * each is parsed on first use, one level at a time, see ut_force(). Saves building parts of
+	 * big documents which are never looked at. */
+	JSON_LAZY
 };
 
 /** Create json parser */
@@ -32,13 +66,108 @@ bool json_setopt(json *j, enum json_option o, long v);
 
 /** Parse given string into unitype node
  * Never fails. In case of syntax error will return a unitype err object.
- * Given string is copied, not referenced */
+ * Given string is copied, not referenced - with JSON_LAZY, the copy lives as long as any T_LAZY
+ * value from it does
+ * @note with JSON_LAZY, T_LAZY values use j when forced: they must not outlive it */
 ut *json_parse(json *j, const char *txt);
 
 /** Print ut as text */
 char *json_print(json *json, ut *var);
 
+/** Append text representation of ut to a rope
+ * Builds the whole document in one pass, without intermediate strings for nested values.
+ * @note string values are referenced, not copied - var must not change until r is flattened */
+void json_print_rope(json *json, ut *var, rope *r);
+
+/** Size of buffer used by json_write_fd() and json_write_file() */
+#define JSON_WRITE_BUF 65536
+
+/** Write ut as text to file descriptor, the same as json_print() would return
+ *
+ * Walks the tree without recursion, writing through a buffer of JSON_WRITE_BUF bytes. Thus memory
+ * used does not depend on size of the document, but only on its depth.
+ * @retval -1  write error, see errno
+ * @return     number of bytes written */
+ssize_t json_write_fd(json *json, ut *var, int fd);
+
+/** Like json_write_fd(), but write to a stdio stream
+ * @note fp is not flushed */
+ssize_t json_write_file(json *json, ut *var, FILE *fp);
+
 /** Helper function: escape string so it can be used in string representation */
 char *json_escape(json *json, const char *str);
 
+/***** binding to C structs *****/
+
+/* Decode JSON objects straight into C structs and back, without building ut trees. Describe the
+ * struct with a static table of fields, ended with JSON_END, eg.:
+ *
+ *   struct msg { int id; char *name; double rate; };
+ *   static const json_field msg_fields[] = {
+ *       JSON_FIELD(struct msg, id, JSON_F_INT),
+ *       JSON_FIELD(struct msg, name, JSON_F_STRING),
+ *       JSON_FIELD(struct msg, rate, JSON_F_DOUBLE),
+ *       JSON_END
+ *   };
+ *
+ * Object keys not in the table are skipped without allocating anything. */
+
+/** Type of struct member */
+enum json_ftype {
+	JSON_F_BOOL = 1,  /** bool */
+	JSON_F_INT,       /** int */
+	JSON_F_UINT,      /** uint32_t */
+	JSON_F_INT64,     /** int64_t */
+	JSON_F_DOUBLE,    /** double */
+	JSON_F_STRING,    /** char *, allocated in json - NULL encodes as null */
+	JSON_F_OBJECT,    /** nested struct, described by sub */
+	JSON_F_UT,        /** ut *, for values of any type - NULL encodes as null */
+};
+
+/** Description of struct member */
+typedef struct json_field {
+	/** Object key */
+	const char *name;
+
+	/** Member type */
+	enum json_ftype type;
+
+	/** offsetof() the member */
+	size_t offset;
+
+	/** Fields of nested struct for JSON_F_OBJECT, NULL otherwise */
+	const struct json_field *sub;
+} json_field;
+
+/** Field with key same as member name */
+#define JSON_FIELD(st, member, type) { #member, (type), offsetof(st, member), NULL }
+
+/** Field with different key */
+#define JSON_FIELD_KEY(key, st, member, type) { (key), (type), offsetof(st, member), NULL }
+
+/** Nested struct member, described by fields */
+#define JSON_FIELD_OBJECT(st, member, fields) { #member, JSON_F_OBJECT, offsetof(st, member), (fields) }
+
+/** End of field table */
+#define JSON_END { NULL, 0, 0, NULL }
+
+/** Decode JSON object in txt into struct at dst
+ *
+ * Members for keys missing in txt, or given as null, are left untouched - initialize dst first.
+ * Integer members take only integral numbers in range of their type - others are errors, and
+ * leave the member untouched.
+ *
+ * @param fields   description of dst
+ * @retval NULL    success
+ * @return         error object, as from json_parse(); dst may be filled partially
+ */
+ut *json_decode(json *j, const char *txt, const json_field *fields, void *dst);
+
+/** Encode struct at src as JSON object, in json_print() format */
+char *json_encode(json *j, const json_field *fields, const void *src);
+
+/** Like json_encode(), but append to a rope
+ * @note strings are referenced, not copied - src must not change until r is flattened */
+void json_encode_rope(json *j, const json_field *fields, const void *src, rope *r);
+
 #endif
@@ -0,0 +1,474 @@
+/*
+ * jsonsax - incremental JSON parser
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include <limits.h>
+#include <ctype.h>
+
+#include "lib.h"
+
+/** Parser states: what is expected next */
+enum state {
+	S_VALUE = 0,    /** value */
+	S_VALUE_END,    /** value or ']', right after '[' */
+	S_KEY,          /** object key */
+	S_KEY_END,      /** object key or '}', right after '{' */
+	S_COLON,        /** ':' after key */
+	S_NEXT,         /** ',' or end of container, after value */
+	S_STRING,       /** inside string */
+	S_ESCAPE,       /** after '\' in string */
+	S_UNICODE,      /** inside \uHHHH */
+	S_NUMBER,       /** inside number */
+	S_LITERAL,      /** inside true, false or null */
+};
+
+#define IS_NUMCHAR(c) (((c) >= '0' && (c) <= '9') || (c) == '-' || (c) == '+' || (c) == '.' || (c) == 'e' || (c) == 'E')
+#define IS_ALPHA(c)   (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z'))
+
+static ut *err(jsonsax *sax, int code, const char *msg)
+{
+	sax->err = ut_new_err(code, msg, mmatic_sprintf(sax->mm, "pos=%llu", (unsigned long long) sax->pos), sax->mm);
+	return sax->err;
+}
+
+/** Call handler */
+static ut *emit(jsonsax *sax, enum jsonsax_event ev, const jsonsax_value *v)
+{
+	if (!sax->cb(sax, ev, v))
+		return err(sax, 1, "stopped by handler");
+
+	return NULL;
+}
+
+/** Set state after a complete value */
+static void value_done(jsonsax *sax)
+{
+	if (sax->depth > 0) {
+		sax->state = S_NEXT;
+	} else {
+		sax->state = S_VALUE;
+		sax->docs++;
+	}
+}
+
+static ut *push(jsonsax *sax, char c)
+{
+	if (sax->depth >= sax->max_depth)
+		return err(sax, 2, "document too deep");
+
+	if (sax->depth == sax->alloc) {
+		sax->alloc *= 2;
+		sax->stack = mmatic_resize(sax->stack, sax->alloc);
+	}
+
+	sax->stack[sax->depth++] = c;
+	return emit(sax, c == '{' ? JSONSAX_OBJECT : JSONSAX_ARRAY, NULL);
+}
+
+static ut *pop(jsonsax *sax, char c)
+{
+	if (sax->depth == 0 || sax->stack[sax->depth - 1] != (c == '}' ? '{' : '['))
+		return err(sax, 3, "unexpected end of container");
+
+	sax->depth--;
+	value_done(sax);
+	return emit(sax, c == '}' ? JSONSAX_OBJECT_END : JSONSAX_ARRAY_END, NULL);
+}
+
+/** Report string in sax->tok */
+static ut *end_string(jsonsax *sax)
+{
+	jsonsax_value v;
+
+	v.str = xsv_xstr(sax->tok);
+	if (sax->key) {
+		sax->state = S_COLON;
+		return emit(sax, JSONSAX_KEY, &v);
+	} else {
+		value_done(sax);
+		return emit(sax, JSONSAX_STRING, &v);
+	}
+}
+
+/** Report number or literal in sax->tok */
+static ut *end_token(jsonsax *sax)
+{
+	jsonsax_value v;
+	enum jsonsax_event ev;
+
+	if (sax->state == S_NUMBER) {
+		switch (pjf_atonum(sax->tok->s, sax->tok->len, &v.i, &v.u, &v.d)) {
+			case PJF_NUM_INT:    ev = JSONSAX_INT;    break;
+			case PJF_NUM_UINT:   ev = JSONSAX_UINT;   break;
+			case PJF_NUM_DOUBLE: ev = JSONSAX_DOUBLE; break;
+			default:             return err(sax, 4, "number: invalid syntax");
+		}
+	} else if (streq(sax->tok->s, "true") || streq(sax->tok->s, "false")) {
+		v.b = (sax->tok->s[0] == 't');
+		ev = JSONSAX_BOOL;
+	} else if (streq(sax->tok->s, "null")) {
+		ev = JSONSAX_NULL;
+	} else {
+		return err(sax, 5, "literal: expected true, false or null");
+	}
+
+	value_done(sax);
+	return emit(sax, ev, &v);
+}
+
+/** Start token of given state with character c */
+static void begin(jsonsax *sax, enum state state, char c)
+{
+	sax->state = state;
+	sax->tok->len = 0;
+	sax->tok->s[0] = '\0';
+
+	if (c)
+		xstr_append_char(sax->tok, c);
+}
+
+/** Handle character c in one of structural states */
+static ut *structural(jsonsax *sax, char c)
+{
+	switch (sax->state) {
+		case S_VALUE:
+		case S_VALUE_END:
+			if (c == ']' && sax->state == S_VALUE_END)
+				return pop(sax, c);
+
+			switch (c) {
+				case '{':
+					sax->state = S_KEY_END;
+					return push(sax, c);
+				case '[':
+					sax->state = S_VALUE_END;
+					return push(sax, c);
+				case '"':
+					sax->key = false;
+					begin(sax, S_STRING, 0);
+					return NULL;
+				case '-': case '0': case '1': case '2': case '3': case '4':
+				case '5': case '6': case '7': case '8': case '9':
+					begin(sax, S_NUMBER, c);
+					return NULL;
+				case 't': case 'f': case 'n':
+					begin(sax, S_LITERAL, c);
+					return NULL;
+			}
+			return err(sax, 6, "value: encountered invalid character");
+
+		case S_KEY:
+		case S_KEY_END:
+			if (c == '}' && sax->state == S_KEY_END)
+				return pop(sax, c);
+
+			if (c != '"')
+				return err(sax, 7, "object: expected key");
+
+			sax->key = true;
+			begin(sax, S_STRING, 0);
+			return NULL;
+
+		case S_COLON:
+			if (c != ':')
+				return err(sax, 8, "object: expected ':'");
+
+			sax->state = S_VALUE;
+			return NULL;
+
+		case S_NEXT:
+			if (c == '}' || c == ']')
+				return pop(sax, c);
+
+			if (c != ',')
+				return err(sax, 9, "expected ',' or end of container");
+
+			sax->state = (sax->stack[sax->depth - 1] == '{') ? S_KEY : S_VALUE;
+			return NULL;
+	}
+
+	return err(sax, 10, "internal error");
+}
+
+ut *jsonsax_feed(jsonsax *sax, const char *buf, size_t len)
+{
+	const char *p = buf, *end = buf + len, *q;
+	ut *rv = NULL;
+	char c;
+
+	if (sax->err)
+		return sax->err;
+
+	while (p < end && !rv) {
+		switch (sax->state) {
+			case S_STRING:
+				/* copy plain characters in runs */
+				for (q = p; q < end && *q != '"' && *q != '\\' && (unsigned char) *q >= 0x20; q++);
+				xstr_append_size(sax->tok, p, q - p);
+				sax->pos += q - p;
+				p = q;
+				if (p == end)
+					break;
+
+				c = *p++;
+				sax->pos++;
+				if (c == '"')
+					rv = end_string(sax);
+				else if (c == '\\')
+					sax->state = S_ESCAPE;
+				else
+					rv = err(sax, 11, "string: control characters not allowed");
+				break;
+
+			case S_ESCAPE:
+				c = *p++;
+				sax->pos++;
+				sax->state = S_STRING;
+				switch (c) {
+					case 'b': c = '\b'; break;
+					case 'f': c = '\f'; break;
+					case 'n': c = '\n'; break;
+					case 'r': c = '\r'; break;
+					case 't': c = '\t'; break;
+					case 'u':
+						sax->state = S_UNICODE;
+						sax->hex = 0;
+						continue;
+					case '\\':
+					case '/':
+					case '"':
+						break;
+					default:
+						rv = err(sax, 12, "string: invalid escape");
+						continue;
+				}
+				xstr_append_char(sax->tok, c);
+				break;
+
+			case S_UNICODE:
+				c = *p++;
+				sax->pos++;
+				if (!isxdigit((unsigned char) c)) {
+					rv = err(sax, 14, "string: incomplete \\u escape");
+					continue;
+				}
+
+				sax->u[sax->hex++] = c;
+				if (sax->hex == 4) {
+					utf8_parse_xcp(sax->tok, sax->u[0], sax->u[1], sax->u[2], sax->u[3]);
+					sax->state = S_STRING;
+				}
+				break;
+
+			case S_NUMBER:
+			case S_LITERAL:
+				c = *p;
+				if (sax->state == S_NUMBER ? IS_NUMCHAR(c) : IS_ALPHA(c)) {
+					xstr_append_char(sax->tok, c);
+					p++;
+					sax->pos++;
+				} else {
+					/* c is not consumed: it ends the token */
+					rv = end_token(sax);
+				}
+				break;
+
+			default:
+				c = *p++;
+				sax->pos++;
+				if (!PJF_IS_WS(c))
+					rv = structural(sax, c);
+				break;
+		}
+	}
+
+	return rv;
+}
+
+ut *jsonsax_end(jsonsax *sax)
+{
+	ut *rv;
+
+	if (sax->err)
+		return sax->err;
+
+	if (sax->state == S_NUMBER || sax->state == S_LITERAL) {
+		rv = end_token(sax);
+		if (rv) return rv;
+	}
+
+	if (sax->depth > 0 || sax->state != S_VALUE)
+		return err(sax, 13, "unexpected end of text");
+
+	return NULL;
+}
+
+void jsonsax_reset(jsonsax *sax)
+{
+	sax->depth = 0;
+	sax->pos = 0;
+	sax->docs = 0;
+	sax->state = S_VALUE;
+	sax->err = NULL;
+	xstr_set(sax->tok, "");
+}
+
+jsonsax *jsonsax_create(jsonsax_cb cb, void *arg, void *mm)
+{
+	jsonsax *sax = mmatic_zalloc(mm, sizeof *sax);
+
+	sax->mm = mm;
+	sax->cb = cb;
+	sax->arg = arg;
+	sax->max_depth = JSONSAX_MAX_DEPTH;
+	sax->state = S_VALUE;
+	sax->tok = xstr_create("", mm);
+	sax->alloc = 32;
+	sax->stack = mmatic_alloc(mm, sax->alloc);
+
+	return sax;
+}
+
+/****************************************************************/
+
+/** State of tree building */
+struct tree {
+	jsonsax_doc_cb done;
+	void *arg;
+	ut *root;         /** last document, if done is NULL */
+
+	ut **nodes;       /** containers being built, one per level */
+	uint32_t alloc;   /** size of nodes */
+	xstr *key;        /** last object key */
+};
+
+/** Put value val at given depth */
+static void tree_add(struct tree *t, uint32_t depth, ut *val)
+{
+	ut *parent;
+
+	if (depth == 0) {
+		if (t->done) {
+			t->done(val, t->arg);
+		} else {
+			if (t->root) ut_free(t->root);
+			t->root = val;
+		}
+		return;
+	}
+
+	parent = t->nodes[depth - 1];
+	if (ut_is_thash(parent))
+		uth_set(parent, xstr_string(t->key), val);
+	else
+		utl_add(parent, val);
+}
+
+static bool tree_cb(jsonsax *sax, enum jsonsax_event ev, const jsonsax_value *v)
+{
+	struct tree *t = sax->arg;
+	ut *val;
+
+	switch (ev) {
+		case JSONSAX_OBJECT:
+		case JSONSAX_ARRAY:
+			val = (ev == JSONSAX_OBJECT) ? ut_new_utthash(NULL, sax->mm) : ut_new_uttlist(NULL, sax->mm);
+
+			if (sax->depth > t->alloc) {
+				t->alloc *= 2;
+				t->nodes = mmatic_resize(t->nodes, t->alloc * sizeof *t->nodes);
+			}
+			t->nodes[sax->depth - 1] = val;
+
+			/* nested containers go to their parent right away, while its key is known;
+			 * top-level ones only when complete */
+			if (sax->depth > 1)
+				tree_add(t, sax->depth - 1, val);
+			return true;
+
+		case JSONSAX_OBJECT_END:
+		case JSONSAX_ARRAY_END:
+			if (sax->depth == 0)
+				tree_add(t, 0, t->nodes[0]);
+			return true;
+
+		case JSONSAX_KEY:
+			xstr_set_size(t->key, v->str.s, v->str.len);
+			return true;
+
+		case JSONSAX_STRING: val = ut_new_char(v->str.s, sax->mm); break;
+		case JSONSAX_INT:
+			if (v->i >= INT_MIN && v->i <= INT_MAX)
+				val = ut_new_int(v->i, sax->mm);
+			else
+				val = ut_new_int64(v->i, sax->mm);
+			break;
+		case JSONSAX_UINT:   val = ut_new_uint64(v->u, sax->mm); break;
+		case JSONSAX_DOUBLE: val = ut_new_double(v->d, sax->mm); break;
+		case JSONSAX_BOOL:   val = ut_new_bool(v->b, sax->mm); break;
+		default:             val = ut_new_null(sax->mm); break;
+	}
+
+	tree_add(t, sax->depth, val);
+	return true;
+}
+
+jsonsax *jsonsax_create_tree(jsonsax_doc_cb done, void *arg, void *mm)
+{
+	struct tree *t = mmatic_zalloc(mm, sizeof *t);
+
+	t->done = done;
+	t->arg = arg;
+	t->alloc = 32;
+	t->nodes = mmatic_alloc(mm, t->alloc * sizeof *t->nodes);
+	t->key = xstr_create("", mm);
+
+	return jsonsax_create(tree_cb, t, mm);
+}
+
+ut *jsonsax_tree_root(jsonsax *sax)
+{
+	struct tree *t = sax->arg;
+	ut *root = t->root;
+
+	t->root = NULL;
+	return root;
+}
+
+void jsonsax_free(jsonsax *sax)
+{
+	struct tree *t;
+
+	if (sax->cb == tree_cb) {
+		t = sax->arg;
+		if (t->root) ut_free(t->root);
+		mmatic_free(t->nodes);
+		xstr_free(t->key);
+		mmatic_free(t->key);
+		mmatic_free(t);
+	}
+
+	if (sax->err) ut_free(sax->err);
+	xstr_free(sax->tok);
+	mmatic_free(sax->tok);
+	mmatic_free(sax->stack);
+	mmatic_free(sax);
+}
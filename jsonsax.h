@@ -0,0 +1,137 @@
+/*
+ * jsonsax - incremental JSON parser
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _JSONSAX_H_
+#define _JSONSAX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "xsv.h"
+#include "unitype.h"
+
+/**
+ * @file jsonsax.h
+ * Push parser for JSON text arriving in pieces, eg. from a socket. Feed it chunks of any size, split
+ * anywhere; it reports what it finds through a callback as soon as possible. Memory use depends on
+ * nesting depth and on the longest single string or number - not on document size.
+ *
+ * Input is a stream of JSON values separated by optional whitespace, eg. a single document or
+ * newline-delimited JSON.
+ */
+
+/** Default limit of nesting depth */
+#define JSONSAX_MAX_DEPTH 1024
+
+/** What the parser found */
+enum jsonsax_event {
+	JSONSAX_OBJECT = 1,   /** start of object */
+	JSONSAX_OBJECT_END,   /** end of object */
+	JSONSAX_ARRAY,        /** start of array */
+	JSONSAX_ARRAY_END,    /** end of array */
+	JSONSAX_KEY,          /** object key, in str */
+	JSONSAX_STRING,       /** string value, in str */
+	JSONSAX_INT,          /** integer value which fits in long long, in i */
+	JSONSAX_DOUBLE,       /** other number, in d */
+	JSONSAX_BOOL,         /** true or false, in b */
+	JSONSAX_NULL,         /** null */
+	JSONSAX_UINT,         /** integer too big for long long, but not for unsigned long long, in u */
+};
+
+/** Value which comes with an event */
+typedef struct jsonsax_value {
+	/** Text of JSONSAX_KEY and JSONSAX_STRING, unescaped and \0-terminated
+	 * @note valid only during the callback */
+	xstr_view str;
+
+	long long i;
+	unsigned long long u;
+	double d;
+	bool b;
+} jsonsax_value;
+
+struct jsonsax;
+
+/** Event handler
+ * @param sax    parser; see sax->arg and sax->depth
+ * @retval false stop parsing - jsonsax_feed() returns an error */
+typedef bool (*jsonsax_cb)(struct jsonsax *sax, enum jsonsax_event ev, const jsonsax_value *v);
+
+/** Parser state, kept between chunks */
+typedef struct jsonsax {
+	void *mm;             /** memory for parser state */
+	jsonsax_cb cb;        /** event handler */
+	void *arg;            /** handler data */
+
+	uint32_t depth;       /** current nesting depth - 0 between top-level values */
+	uint32_t max_depth;   /** limit of depth, see JSONSAX_MAX_DEPTH */
+	uint64_t pos;         /** number of bytes consumed */
+	uint64_t docs;        /** number of complete top-level values */
+
+	/* internal */
+	int state;            /** what comes next, see jsonsax.c */
+	bool key;             /** string being read is an object key */
+	int hex;              /** number of \uHHHH digits read */
+	char u[4];            /** \uHHHH digits */
+	xstr *tok;            /** text of current string, number or literal */
+	char *stack;          /** '{' or '[' for each level */
+	uint32_t alloc;       /** size of stack */
+	ut *err;              /** error, once there is one */
+} jsonsax;
+
+/** Create parser
+ * @param cb     event handler
+ * @param arg    handler data, in sax->arg */
+jsonsax *jsonsax_create(jsonsax_cb cb, void *arg, void *mm);
+
+/** Parse next chunk of text
+ * @retval NULL  success, so far
+ * @return       error object, as from json_parse(); all later calls return it too */
+ut *jsonsax_feed(jsonsax *sax, const char *buf, size_t len);
+
+/** Signal end of text
+ * Finishes a number or literal at the very end, and checks that no value is left incomplete.
+ * @retval NULL  success
+ * @return       error object */
+ut *jsonsax_end(jsonsax *sax);
+
+/** Forget state and error, so that the parser can start over */
+void jsonsax_reset(jsonsax *sax);
+
+/** Free the parser */
+void jsonsax_free(jsonsax *sax);
+
+/***** building ut trees *****/
+
+/** Called with each complete top-level value
+ * @param doc    tree, allocated in parser memory - to be released with ut_free() */
+typedef void (*jsonsax_doc_cb)(ut *doc, void *arg);
+
+/** Create parser which builds ut trees, like json_parse()
+ * @param done   called for each top-level value; if NULL, use jsonsax_tree_root()
+ * @param arg    passed to done */
+jsonsax *jsonsax_create_tree(jsonsax_doc_cb done, void *arg, void *mm);
+
+/** Take last complete top-level value built by tree parser created without done
+ * @retval NULL  no new value since last call */
+ut *jsonsax_tree_root(jsonsax *sax);
+
+#endif /* _JSONSAX_H_ */
@@ -308,57 +308,51 @@ int pjf_rmdir(const char *path, const char *skip)
 	return 1;
 }
 
-static int vsort(const struct dirent **a, const struct dirent **b)
-	{ return strverscmp((*a)->d_name, (*b)->d_name); }
-
-static int filterdots(const struct dirent *d)
-	{ return (!streq(d->d_name, ".") && !streq(d->d_name, "..")); }
+static int vsort(const void *a, const void *b)
+	{ return strverscmp(a, b); }
 
 tlist *pjf_ls(const char *path, void *mm)
 {
-	int i, n;
-	struct dirent **entries;
+	DIR *dir;
+	struct dirent *d;
 	tlist *ret = tlist_create(NULL, mm);
 
-	n = scandir(path, &entries, filterdots, vsort);
-	for (i = 0; i < n; i++) {
-		tlist_push(ret, mmatic_strdup(mm, entries[i]->d_name));
-		free(entries[i]);
-	}
+	dir = opendir(path);
+	if (!dir) return ret;
 
-	if (n >= 0)
-		free(entries);
+	while ((d = readdir(dir))) {
+		if (streq(d->d_name, ".") || streq(d->d_name, "..")) continue;
+		tlist_push(ret, mmatic_strdup(mm, d->d_name));
+	}
+	closedir(dir);
 
+	/* sort names in place instead of copying dirents around, as scandir() does */
+	tlist_sort(ret, vsort);
 	return ret;
 }
 
 char *pjf_readfile(const char *path, void *mm)
 {
-	FILE *fp;
-	char *buf, *rbuf;
-	uint32_t bigbufsiz, bufsiz;
+	int fd;
+	xstr *xs;
+	char *ret;
 
-	if ((fp = fopen(path, "r")) == NULL)
+	if ((fd = open(path, O_RDONLY)) < 0)
 		return NULL;
 
-	bigbufsiz = bufsiz = 4096;
-	rbuf = buf = mmatic_alloc(mm, bufsiz);
-
-	for (;;) {
-		memset(buf, 0, bufsiz);
-		fread(buf, 1, bufsiz, fp); /* fast? */
-
-		if (feof(fp) || ferror(fp) || bigbufsiz > 100000000) break;
-
-		bufsiz = bigbufsiz;
-		bigbufsiz *= 2;
+	/* read straight into xstr memory, sized by fstat() */
+	xs = xstr_create("", mm);
+	xstr_slurp_fd(xs, fd);
+	close(fd);
 
-		rbuf = mmatic_resize(rbuf, bigbufsiz);
-		buf = rbuf + bufsiz; /* start from half */
-	}
+	/* return memory that the caller may mmatic_free() */
+	if (xstr_is_inline(xs))
+		ret = mmatic_strdup(mm, xs->s);
+	else
+		ret = xs->s;
 
-	fclose(fp);
-	return rbuf;
+	mmatic_free(xs);
+	return ret;
 }
 
 int pjf_writefile(const char *path, const char *s)
@@ -480,15 +474,13 @@ void pjf_daemonize(const char *progname, const char *pidfile)
 
 char *pjf_trim(char *txt)
 {
-	int i;
-	char c;
+	size_t i;
 
 	if (!txt[0]) return txt;
 
-	while ((c = *txt) && (c == ' ' || c == '\n' || c == '\t')) txt++;
-	for (i = 0; txt[i]; i++);
-	for (i -= 1; i > 0 && (c = txt[i]) && (c == ' ' || c == '\n' || c == '\t'); i--);
-	txt[i + 1] = '\0';
+	txt = (char *) pjf_scan_ws(txt);
+	for (i = strlen(txt); i > 0 && PJF_IS_WS(txt[i - 1]); i--);
+	txt[i] = '\0';
 
 	return txt;
 }
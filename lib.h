@@ -92,9 +92,21 @@ char *pjf_malloc_sprintf(const char *fmt, ...);
 #include "math.h"
 #include "regex.h"
 #include "xstr.h"
+#include "xsv.h"
+#include "rope.h"
+#include "scan.h"
+#include "number.h"
 #include "unitype.h"
+#include "utpath.h"
+#include "utintern.h"
+#include "utpatch.h"
+#include "utcol.h"
 #include "json.h"
+#include "jsonsax.h"
+#include "ndjson.h"
+#include "cbor.h"
 #include "utf8.h"
+#include "sort.h"
 
 /*****************************************************************************/
 
@@ -102,7 +114,7 @@ char *pjf_malloc_sprintf(const char *fmt, ...);
 #define streq(a, b) (strcmp((a), (b)) == 0)
 
 /** Trim string from both sides
- * @note removes ' ', '\t' and '\n'
+ * @note removes whitespace, as in pjf_scan_ws()
  * @note modifies txt and returns memory location within it */
 char *pjf_trim(char *txt);
 
@@ -179,7 +191,7 @@ tlist *pjf_ls(const char *path, void *mm);
 
 /** Read whole file
  * @param  path  path to file
- * @retval null  fopen() failed */
+ * @retval null  open() failed */
 char *pjf_readfile(const char *path, void *mm);
 
 /** Write file at once - simple wrapper around fputs()
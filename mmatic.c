@@ -59,6 +59,7 @@ void *mmatic_create(void)
 	ALLOC(mgr, sizeof(mmatic));
 	mgr->tag = TAG_MGR;
 	mgr->totalloc = 0;
+	mgr->utaux = NULL;
 
 	ALLOC(mgr->first, sizeof(mmchunk));
 	mgr->last = mgr->first;
@@ -143,6 +144,20 @@ void *_mmatic_copy(const void *mem, void *mm, const char *cfile, unsigned int cl
 	return newmem;
 }
 
+mmatic *mmatic_mgr(const void *mgr_or_mem)
+{
+	mmatic *mgr = (mmatic *) mgr_or_mem;
+	mmchunk *chunk;
+
+	if (IS_MGR(mgr))
+		return mgr;
+
+	chunk = PTR_TO_CHUNK(mgr_or_mem);
+	pjf_assert(IS_CHUNK(chunk));
+
+	return chunk->mgr;
+}
+
 /*****************************************************************************/
 /************************** Free functions ***********************************/
 /*****************************************************************************/
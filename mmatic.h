@@ -47,6 +47,7 @@ typedef struct mmatic {
 	mmchunk *first;            /** First chunk */
 	mmchunk *last;             /** Last chunk */
 	unsigned int totalloc;     /** Total allocation */
+	void *utaux;               /** Extra data of unitype nodes allocated here, see unitype.c */
 } mmatic;
 
 /*****************************************************************************/
@@ -103,6 +104,10 @@ void *_mmatic_copy(const void *mem, void *mm, const char *cfile, unsigned int cl
  * @return   copy of mem */
 #define mmatic_copy(mem) _mmatic_copy((mem), NULL, __FILE__, __LINE__)
 
+/** Return manager of given memory
+ * @param mgr_or_mem    memory manager or memory (see _mmatic_alloc()) */
+mmatic *mmatic_mgr(const void *mgr_or_mem);
+
 /*****************************************************************************/
 
 /** Frees all memory and destroys given manager
@@ -0,0 +1,365 @@
+/*
+ * ndjson - parallel reader of newline-delimited JSON
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lib.h"
+
+/** Part of input, parsed by one thread */
+struct piece {
+	size_t start;         /** offset of first line */
+	size_t end;           /** offset after last line */
+
+	/* in order mode only */
+	mmatic *mm;           /** memory of records */
+	struct rec {
+		ut *ut;
+		size_t off;
+	} *recs;              /** records parsed */
+	uint32_t n;           /** number of records */
+	uint32_t a;           /** allocated records */
+	bool done;            /** recs are complete */
+};
+
+/** State of one ndjson_read() call, shared by threads */
+struct run {
+	ndjson *nd;
+	const char *buf;
+
+	struct piece *p;      /** pieces of buf */
+	uint32_t n;           /** number of pieces */
+	uint32_t next;        /** next piece to parse */
+	uint32_t delivered;   /** pieces delivered, in order mode */
+	uint32_t ahead;       /** max pieces parsed but not delivered yet, in order mode */
+	bool stop;            /** handler asked to stop */
+
+	pthread_mutex_t lock;
+	pthread_cond_t done;  /** some piece is done */
+	pthread_cond_t room;  /** some piece was delivered */
+};
+
+ndjson *ndjson_create(ndjson_cb cb, void *arg, void *mm)
+{
+	ndjson *nd = mmatic_zalloc(mm, sizeof(ndjson));
+
+	nd->mm = mm;
+	nd->cb = cb;
+	nd->arg = arg;
+	nd->chunk = NDJSON_CHUNK_SIZE;
+
+	return nd;
+}
+
+bool ndjson_setopt(ndjson *nd, enum ndjson_option o, long v)
+{
+	switch (o) {
+		case NDJSON_THREADS:
+			nd->threads = (v > 0) ? v : 0;
+			break;
+		case NDJSON_UNORDERED:
+			nd->unordered = (bool) v;
+			break;
+		case NDJSON_CHUNK:
+			nd->chunk = (v > 0) ? v : NDJSON_CHUNK_SIZE;
+			break;
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+bool ndjson_json_setopt(ndjson *nd, enum json_option o, long v)
+{
+	if (nd->njopt == NDJSON_JSON_OPTS)
+		return false;
+
+	nd->jopt[nd->njopt].o = o;
+	nd->jopt[nd->njopt].v = v;
+	nd->njopt++;
+
+	return true;
+}
+
+void ndjson_free(ndjson *nd)
+{
+	mmatic_free(nd);
+}
+
+/** Parse one line, copied to line so that it is \0-terminated
+ * @retval NULL  blank line */
+static ut *parse_line(json *j, xstr *line, const char *s, size_t len)
+{
+	ut *rec;
+
+	xstr_set_size(line, s, len);
+	if (pjf_scan_ws(line->s) == line->s + len)
+		return NULL;
+
+	rec = json_parse(j, line->s);
+	if (ut_ok(rec) && pjf_scan_ws(line->s + j->i) != line->s + len)
+		return ut_new_err(1, "ndjson: text after value", mmatic_sprintf(j, "i=%d", j->i), j);
+
+	return rec;
+}
+
+/** Parse piece p, delivering records right away or storing them in p */
+static void parse_piece(struct run *run, struct piece *p, bool store)
+{
+	ndjson *nd = run->nd;
+	const char *s = run->buf + p->start, *end = run->buf + p->end, *eol;
+	mmatic *mm = mmatic_create();
+	xstr *line = xstr_create("", mm);
+	json *j = json_create(mm);
+	ut *rec;
+	int i;
+
+	for (i = 0; i < nd->njopt; i++)
+		json_setopt(j, nd->jopt[i].o, nd->jopt[i].v);
+
+	for (; s < end && !__atomic_load_n(&run->stop, __ATOMIC_RELAXED); s = eol + 1) {
+		eol = memchr(s, '\n', end - s);
+		if (!eol) eol = end;
+
+		rec = parse_line(j, line, s, eol - s);
+		if (!rec)
+			continue;
+
+		if (!store) {
+			__atomic_add_fetch(&nd->records, 1, __ATOMIC_RELAXED);
+			if (!nd->cb(nd, rec, s - run->buf))
+				__atomic_store_n(&run->stop, true, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		if (p->n == p->a) {
+			p->a = p->a ? 2 * p->a : 256;
+			p->recs = p->recs ? mmatic_resize(p->recs, p->a * sizeof(struct rec)) :
+				mmatic_alloc(mm, p->a * sizeof(struct rec));
+		}
+		p->recs[p->n].ut = rec;
+		p->recs[p->n].off = s - run->buf;
+		p->n++;
+	}
+
+	if (store)
+		p->mm = mm;
+	else
+		mmatic_destroy(mm);
+}
+
+/** Thread parsing pieces, until there are none left */
+static void *worker(void *arg)
+{
+	struct run *run = arg;
+	bool store = !run->nd->unordered, stop;
+	struct piece *p;
+
+	for (;;) {
+		pthread_mutex_lock(&run->lock);
+		stop = __atomic_load_n(&run->stop, __ATOMIC_RELAXED);
+		while (store && !stop && run->next < run->n && run->next >= run->delivered + run->ahead) {
+			pthread_cond_wait(&run->room, &run->lock);
+			stop = __atomic_load_n(&run->stop, __ATOMIC_RELAXED);
+		}
+
+		if (stop || run->next == run->n) {
+			pthread_mutex_unlock(&run->lock);
+			return NULL;
+		}
+
+		p = &run->p[run->next++];
+		pthread_mutex_unlock(&run->lock);
+
+		parse_piece(run, p, store);
+
+		if (store) {
+			pthread_mutex_lock(&run->lock);
+			p->done = true;
+			pthread_cond_broadcast(&run->done);
+			pthread_mutex_unlock(&run->lock);
+		}
+	}
+}
+
+/** Deliver stored records of all pieces in order */
+static void deliver(struct run *run)
+{
+	ndjson *nd = run->nd;
+	struct piece *p;
+	uint32_t k, i;
+
+	for (k = 0; k < run->n; k++) {
+		p = &run->p[k];
+
+		pthread_mutex_lock(&run->lock);
+		while (!p->done)
+			pthread_cond_wait(&run->done, &run->lock);
+		pthread_mutex_unlock(&run->lock);
+
+		for (i = 0; i < p->n; i++) {
+			nd->records++;
+			if (!nd->cb(nd, p->recs[i].ut, p->recs[i].off)) {
+				__atomic_store_n(&run->stop, true, __ATOMIC_RELAXED);
+				break;
+			}
+		}
+
+		mmatic_destroy(p->mm);
+		p->mm = NULL;
+
+		pthread_mutex_lock(&run->lock);
+		run->delivered++;
+		pthread_cond_broadcast(&run->room);
+		pthread_mutex_unlock(&run->lock);
+
+		if (i < p->n)
+			break;
+	}
+}
+
+/** Split buf into pieces of at least nd->chunk bytes, ending at newlines */
+static uint32_t split(struct run *run, size_t len)
+{
+	size_t start = 0, end;
+	const char *nl;
+	uint32_t n = 0;
+
+	run->p = mmatic_zalloc(run->nd->mm, (len / run->nd->chunk + 1) * sizeof(struct piece));
+
+	while (start < len) {
+		end = start + run->nd->chunk;
+		if (end >= len) {
+			end = len;
+		} else {
+			nl = memchr(run->buf + end, '\n', len - end);
+			end = nl ? nl - run->buf + 1 : len;
+		}
+
+		run->p[n].start = start;
+		run->p[n].end = end;
+		n++;
+
+		start = end;
+	}
+
+	return n;
+}
+
+ut *ndjson_read(ndjson *nd, const char *buf, size_t len)
+{
+	struct run run = { .nd = nd, .buf = buf };
+	pthread_t *tid;
+	int threads, started, i;
+	uint32_t k;
+
+	nd->records = 0;
+	run.n = split(&run, len);
+
+	threads = nd->threads ? nd->threads : sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > run.n) threads = run.n;
+	if (threads < 1) threads = 1;
+	run.ahead = 2 * threads;
+
+	/* choose SIMD implementation before threads race to do it */
+	pjf_scan_impl();
+
+	pthread_mutex_init(&run.lock, NULL);
+	pthread_cond_init(&run.done, NULL);
+	pthread_cond_init(&run.room, NULL);
+
+	tid = mmatic_alloc(nd->mm, threads * sizeof(pthread_t));
+	for (started = 0; threads > 1 && started < threads; started++) {
+		if (pthread_create(&tid[started], NULL, worker, &run) != 0)
+			break;
+	}
+
+	if (started == 0) {
+		/* one thread, or none could be started: input order comes by itself */
+		for (k = 0; k < run.n && !run.stop; k++)
+			parse_piece(&run, &run.p[k], false);
+	} else if (!nd->unordered) {
+		deliver(&run);
+	}
+
+	/* if stopped early, wake threads waiting for room */
+	pthread_mutex_lock(&run.lock);
+	pthread_cond_broadcast(&run.room);
+	pthread_mutex_unlock(&run.lock);
+
+	for (i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+
+	/* pieces parsed but not delivered */
+	for (k = 0; k < run.n; k++) {
+		if (run.p[k].mm)
+			mmatic_destroy(run.p[k].mm);
+	}
+
+	pthread_cond_destroy(&run.room);
+	pthread_cond_destroy(&run.done);
+	pthread_mutex_destroy(&run.lock);
+	mmatic_free(tid);
+	mmatic_free(run.p);
+
+	if (run.stop)
+		return ut_new_err(2, "ndjson: stopped by handler", NULL, nd->mm);
+
+	return NULL;
+}
+
+ut *ndjson_read_file(ndjson *nd, const char *path)
+{
+	struct stat st;
+	void *map;
+	ut *rv;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return ut_new_errno(nd->mm);
+
+	if (fstat(fd, &st) != 0) {
+		rv = ut_new_errno(nd->mm);
+		close(fd);
+		return rv;
+	}
+
+	if (st.st_size == 0) {
+		close(fd);
+		return ndjson_read(nd, "", 0);
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	rv = (map == MAP_FAILED) ? ut_new_errno(nd->mm) : NULL;
+	close(fd);
+	if (rv) return rv;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	rv = ndjson_read(nd, map, st.st_size);
+	munmap(map, st.st_size);
+
+	return rv;
+}
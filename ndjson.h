@@ -0,0 +1,108 @@
+/*
+ * ndjson - parallel reader of newline-delimited JSON
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NDJSON_H_
+#define _NDJSON_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "unitype.h"
+#include "json.h"
+
+/**
+ * @file ndjson.h
+ * Reader of newline-delimited JSON (JSON Lines): one value per line, blank lines ignored. Input
+ * is split at line boundaries into pieces, which are parsed by a pool of threads - each with own
+ * parser and memory manager - and the records are delivered to a callback.
+ */
+
+/** Default size of a piece of input, see NDJSON_CHUNK */
+#define NDJSON_CHUNK_SIZE (1024 * 1024)
+
+/** Max number of JSON parser options, see ndjson_json_setopt() */
+#define NDJSON_JSON_OPTS 8
+
+struct ndjson;
+
+/** Record handler
+ * @param nd     reader; see nd->arg
+ * @param rec    the record, or an error object if its line is not valid JSON
+ * @param off    offset of the line in input
+ * @retval false stop reading - ndjson_read() returns an error
+ * @note rec lives in memory of a worker thread and is freed soon after the callback returns: use
+ *       ut_clone() to keep it, remembering that mmatic is not thread-safe */
+typedef bool (*ndjson_cb)(struct ndjson *nd, ut *rec, size_t off);
+
+enum ndjson_option {
+	/** Number of threads to parse with; 0 (default) uses one per online CPU */
+	NDJSON_THREADS = 1,
+
+	/** If true, call the handler from worker threads as soon as records are parsed - so in no
+	 * particular order, and for many records at the same time. By default, records are delivered
+	 * in input order, from the thread calling ndjson_read(). */
+	NDJSON_UNORDERED,
+
+	/** Size of a piece of input parsed by a thread at once, default NDJSON_CHUNK_SIZE */
+	NDJSON_CHUNK
+};
+
+/** Reader settings */
+typedef struct ndjson {
+	void *mm;             /** memory for the reader */
+	ndjson_cb cb;         /** record handler */
+	void *arg;            /** handler data */
+
+	int threads;          /** see NDJSON_THREADS */
+	bool unordered;       /** see NDJSON_UNORDERED */
+	size_t chunk;         /** see NDJSON_CHUNK */
+
+	/** Options for parsers, see ndjson_json_setopt() */
+	struct { enum json_option o; long v; } jopt[NDJSON_JSON_OPTS];
+	int njopt;
+
+	uint64_t records;     /** number of records delivered by last ndjson_read() */
+} ndjson;
+
+/** Create reader
+ * @param cb     record handler
+ * @param arg    handler data, in nd->arg */
+ndjson *ndjson_create(ndjson_cb cb, void *arg, void *mm);
+
+/** Set reader option */
+bool ndjson_setopt(ndjson *nd, enum ndjson_option o, long v);
+
+/** Set option of JSON parsers used for records, see json_setopt()
+ * @retval false  too many options */
+bool ndjson_json_setopt(ndjson *nd, enum json_option o, long v);
+
+/** Parse len bytes of text at buf
+ * @retval NULL  success
+ * @return       error object, if the handler stopped reading */
+ut *ndjson_read(ndjson *nd, const char *buf, size_t len);
+
+/** Memory-map file at path and parse it with ndjson_read()
+ * @return  as ndjson_read(), or error object with errno if the file can not be read */
+ut *ndjson_read_file(ndjson *nd, const char *path);
+
+/** Free the reader */
+void ndjson_free(ndjson *nd);
+
+#endif /* _NDJSON_H_ */
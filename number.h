@@ -0,0 +1,67 @@
+/*
+ * number - fast number to text conversion and back
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NUMBER_H_
+#define _NUMBER_H_
+
+/**
+ * @file number.h
+ * Locale-independent number formatting, without going through printf(). Integers are written two
+ * digits at a time; doubles use Grisu2, giving the shortest (or nearly so) text which reads back
+ * as exactly the same double.
+ *
+ * Parsing is locale-independent too, unlike strtod().
+ */
+
+/** Minimal size of buffers passed to functions below */
+#define PJF_NUMBUF 32
+
+/** Write signed integer in decimal
+ * @return length of text, not counting the trailing \0 */
+int pjf_itoa(long long v, char *buf);
+
+/** Write unsigned integer in decimal
+ * @return length of text, not counting the trailing \0 */
+int pjf_utoa(unsigned long long v, char *buf);
+
+/** Write double as shortest text that converts back to v
+ *
+ * Output follows JavaScript rules: "1", "0.5", "1e+21", "1.5e-7". Non-finite numbers give
+ * "nan", "inf" and "-inf".
+ *
+ * @return length of text, not counting the trailing \0 */
+int pjf_dtoa(double v, char *buf);
+
+/** Kind of number found by pjf_atonum() */
+enum pjf_numtype {
+	PJF_NUM_INVALID = 0,  /** not exactly one valid JSON number */
+	PJF_NUM_INT,          /** integer which fits in long long, in *iv */
+	PJF_NUM_UINT,         /** integer too big for long long, but not for unsigned long long, in *uv */
+	PJF_NUM_DOUBLE,       /** any other number, in *dv */
+};
+
+/** Parse JSON number from len bytes at s - not \0-terminated
+ *
+ * Numbers with a fraction or exponent, and integers out of 64-bit range, are correctly rounded to
+ * the nearest double - usually without big-number arithmetic, see eisel_lemire() in number.c.
+ */
+enum pjf_numtype pjf_atonum(const char *s, size_t len, long long *iv, unsigned long long *uv, double *dv);
+
+#endif /* _NUMBER_H_ */
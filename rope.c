@@ -0,0 +1,213 @@
+/*
+ * rope - chunked string builder
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "lib.h"
+
+/** Maximum number of fragments passed to one writev() call */
+#define ROPE_IOV_BATCH 256
+
+rope *rope_create(void *mm)
+{
+	rope *r = mmatic_zalloc(mm, sizeof(rope));
+
+	r->mm = mm;
+	return r;
+}
+
+/** Allocate new chunk for copied data, linking it with the previous ones */
+static char *new_chunk(rope *r, size_t size)
+{
+	void **mem = mmatic_alloc(r->mm, sizeof(void *) + size);
+
+	mem[0] = r->chunks;
+	r->chunks = mem;
+
+	return (char *) (mem + 1);
+}
+
+static void add_fragment(rope *r, const char *s, size_t size)
+{
+	struct iovec *last;
+
+	/* continue last fragment if s is right after it */
+	if (r->n > 0) {
+		last = &r->iov[r->n - 1];
+		if ((const char *) last->iov_base + last->iov_len == s) {
+			last->iov_len += size;
+			r->len += size;
+			return;
+		}
+	}
+
+	if (r->n == r->a) {
+		r->a = r->a ? 2 * r->a : 16;
+		if (r->iov)
+			r->iov = mmatic_resize(r->iov, r->a * sizeof(struct iovec));
+		else
+			r->iov = mmatic_alloc(r->mm, r->a * sizeof(struct iovec));
+	}
+
+	r->iov[r->n].iov_base = (void *) s;
+	r->iov[r->n].iov_len = size;
+	r->n++;
+	r->len += size;
+}
+
+void rope_append_size(rope *r, const char *s, size_t size)
+{
+	char *dst;
+
+	if (!s || size == 0) return;
+
+	if (size > r->bufsize - r->bufused) {
+		/* big pieces get own chunks, so that the current one is not wasted */
+		if (size >= ROPE_CHUNK / 4) {
+			dst = new_chunk(r, size);
+			memcpy(dst, s, size);
+			add_fragment(r, dst, size);
+			return;
+		}
+
+		r->buf = new_chunk(r, ROPE_CHUNK);
+		r->bufsize = ROPE_CHUNK;
+		r->bufused = 0;
+	}
+
+	dst = r->buf + r->bufused;
+	memcpy(dst, s, size);
+	r->bufused += size;
+	add_fragment(r, dst, size);
+}
+
+void rope_append(rope *r, const char *s)
+{
+	if (s) rope_append_size(r, s, strlen(s));
+}
+
+void rope_append_char(rope *r, char c)
+{
+	rope_append_size(r, &c, 1);
+}
+
+void rope_borrow(rope *r, const char *s, size_t size)
+{
+	if (!s || size == 0) return;
+
+	if (size < ROPE_BORROW_MIN)
+		rope_append_size(r, s, size);
+	else
+		add_fragment(r, s, size);
+}
+
+void rope_flatten(rope *r, xstr *xs)
+{
+	unsigned int i;
+	char *dst;
+
+	xstr_reserve(xs, xs->len + r->len);
+
+	dst = xs->s + xs->len;
+	for (i = 0; i < r->n; i++) {
+		memcpy(dst, r->iov[i].iov_base, r->iov[i].iov_len);
+		dst += r->iov[i].iov_len;
+	}
+
+	xs->len += r->len;
+	xs->s[xs->len] = '\0';
+}
+
+char *rope_string(rope *r, void *mm)
+{
+	unsigned int i;
+	char *ret, *dst;
+
+	dst = ret = mmatic_alloc(mm, r->len + 1);
+	for (i = 0; i < r->n; i++) {
+		memcpy(dst, r->iov[i].iov_base, r->iov[i].iov_len);
+		dst += r->iov[i].iov_len;
+	}
+	*dst = '\0';
+
+	return ret;
+}
+
+ssize_t rope_write(rope *r, int fd)
+{
+	struct iovec batch[ROPE_IOV_BATCH];
+	unsigned int i = 0, n, j;
+	ssize_t rc, total = 0;
+
+	while (i < r->n) {
+		n = MIN(r->n - i, ROPE_IOV_BATCH);
+		memcpy(batch, r->iov + i, n * sizeof(struct iovec));
+
+		for (j = 0; j < n;) {
+			rc = writev(fd, batch + j, n - j);
+			if (rc < 0) {
+				if (errno == EINTR) continue;
+				return -1;
+			}
+			total += rc;
+
+			/* skip what was written, possibly in the middle of a fragment */
+			while (j < n && (size_t) rc >= batch[j].iov_len)
+				rc -= batch[j++].iov_len;
+
+			if (j < n) {
+				batch[j].iov_base = (char *) batch[j].iov_base + rc;
+				batch[j].iov_len -= rc;
+			}
+		}
+
+		i += n;
+	}
+
+	return total;
+}
+
+void rope_reset(rope *r)
+{
+	void **chunk, **prev;
+
+	for (chunk = r->chunks; chunk; chunk = prev) {
+		prev = chunk[0];
+		mmatic_free(chunk);
+	}
+
+	r->chunks = NULL;
+	r->buf = NULL;
+	r->bufused = r->bufsize = 0;
+	r->n = 0;
+	r->len = 0;
+}
+
+void rope_free(rope *r)
+{
+	if (!r) return;
+
+	rope_reset(r);
+	if (r->iov) mmatic_free(r->iov);
+	mmatic_free(r);
+}
@@ -0,0 +1,107 @@
+/*
+ * rope - chunked string builder
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ROPE_H_
+#define _ROPE_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "mmatic.h"
+#include "xstr.h"
+
+/** Size of memory chunks for copied fragments */
+#define ROPE_CHUNK 8192
+
+/** Borrowed slices shorter than that are copied anyway - cheaper than one more fragment */
+#define ROPE_BORROW_MIN 64
+
+/** A rope: list of fragments which are concatenated only when needed
+ *
+ * Small appends are copied into rope-owned chunks, big slices can be referenced (borrowed) without
+ * copying at all. Use rope_flatten() to get one string, or rope_write() to send it to a file
+ * descriptor with writev(). */
+typedef struct rope {
+	/** Fragments */
+	struct iovec *iov;
+
+	/** Number of fragments */
+	unsigned int n;
+
+	/** Allocated fragments */
+	unsigned int a;
+
+	/** Current chunk for copied data */
+	char *buf;
+
+	/** Used bytes in buf */
+	size_t bufused;
+
+	/** Size of buf */
+	size_t bufsize;
+
+	/** Last allocated chunk, each chunk begins with pointer to previous one */
+	void *chunks;
+
+	/** Total length */
+	size_t len;
+
+	/** mmatic */
+	void *mm;
+} rope;
+
+/** Create empty rope */
+rope *rope_create(void *mm);
+
+/** Append a copy of string */
+void rope_append(rope *r, const char *s);
+
+/** Append a copy of size bytes from s */
+void rope_append_size(rope *r, const char *s, size_t size);
+
+/** Append one char */
+void rope_append_char(rope *r, char c);
+
+/** Append a slice of memory by reference
+ * @note the memory must not change until rope is flattened, written or freed */
+void rope_borrow(rope *r, const char *s, size_t size);
+
+/** Return total length of rope */
+#define rope_length(r) ((r) ? (r)->len : 0)
+
+/** Append whole rope contents to given xstr */
+void rope_flatten(rope *r, xstr *xs);
+
+/** Return rope contents as a new string allocated in mm */
+char *rope_string(rope *r, void *mm);
+
+/** Write whole rope to a file descriptor using writev()
+ * @note handles partial writes and EINTR
+ * @retval -1   write error, see errno
+ * @return      number of bytes written */
+ssize_t rope_write(rope *r, int fd);
+
+/** Drop all fragments and chunks, leaving an empty rope */
+void rope_reset(rope *r);
+
+/** Free a rope */
+void rope_free(rope *r);
+
+#endif /* _ROPE_H_ */
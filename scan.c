@@ -0,0 +1,452 @@
+/*
+ * scan - vectorized string scanning kernels
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lib.h"
+
+/* the SIMD kernels read past the \0 terminator, up to the end of its aligned block - harmless, but
+ * AddressSanitizer reports it, so use plain C when building with it */
+#if defined(__SANITIZE_ADDRESS__)
+#define SCAN_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SCAN_ASAN 1
+#endif
+#endif
+
+#if !defined(SCAN_ASAN) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/** Round pointer down to multiple of n */
+#define ALIGN_DOWN(p, n) ((const char *) ((uintptr_t) (p) & ~((uintptr_t) (n) - 1)))
+
+/*****************************************************************************/
+/******************************** Plain C ************************************/
+/*****************************************************************************/
+
+#ifndef SCAN_X86
+static const char *c_scan_ws(const char *s)
+{
+	while (PJF_IS_WS(*s)) s++;
+	return s;
+}
+
+static const char *c_scan_str(const char *s)
+{
+	unsigned char c;
+
+	while ((c = *s) >= 0x20 && c != '"' && c != '\\') s++;
+	return s;
+}
+
+static const char *c_scan_chr(const char *s, int c)
+{
+	while (*s && *s != (char) c) s++;
+	return s;
+}
+#endif
+
+static const char *c_scan_ctrl(const char *s, size_t len)
+{
+	const char *end = s + len;
+
+	for (; s < end; s++)
+		if ((unsigned char) *s < 0x20) return s;
+
+	return NULL;
+}
+
+/** Bit masks of interesting bytes in a 64-byte block, bit i for byte i */
+struct scan_block {
+	uint64_t bs;      /** '\\' */
+	uint64_t quote;   /** '"' */
+	uint64_t op;      /** '{', '}', '[', ']', ':' and ',' */
+	uint64_t ws;      /** whitespace, as in PJF_IS_WS() */
+	uint64_t ctrl;    /** control characters, < 0x20 */
+};
+
+#ifndef SCAN_X86
+static void c_scan_block(const char *s, struct scan_block *b)
+{
+	unsigned char c;
+	uint64_t bit;
+	int i;
+
+	memset(b, 0, sizeof *b);
+	for (i = 0; i < 64; i++) {
+		c = s[i];
+		bit = 1ULL << i;
+
+		if (c == '\\') b->bs |= bit;
+		else if (c == '"') b->quote |= bit;
+		else if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') b->op |= bit;
+
+		if (PJF_IS_WS(c)) b->ws |= bit;
+		if (c < 0x20) b->ctrl |= bit;
+	}
+}
+#endif
+
+#ifdef SCAN_X86
+/*****************************************************************************/
+/********************************** SSE2 *************************************/
+/*****************************************************************************/
+
+/* each kernel computes a 16-bit mask of "stop" bytes in an aligned block - bytes before the start
+ * of string are shifted out of the first mask */
+#define SSE2_SCAN(s, MASK) do {                                   \
+	const char *p_ = ALIGN_DOWN(s, 16);                           \
+	__m128i v;                                                    \
+	unsigned int m_;                                              \
+	v = _mm_load_si128((const __m128i *) p_);                     \
+	m_ = (MASK) >> (s - p_);                                      \
+	if (m_) return s + __builtin_ctz(m_);                         \
+	for (;;) {                                                    \
+		p_ += 16;                                                 \
+		v = _mm_load_si128((const __m128i *) p_);                 \
+		m_ = (MASK);                                              \
+		if (m_) return p_ + __builtin_ctz(m_);                    \
+	}                                                             \
+} while (0)
+
+/** Mark bytes c with lo <= c <= lo + n, compared unsigned */
+static inline __m128i sse2_range(__m128i v, char lo, char n)
+{
+	__m128i t = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+	return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(n)), t);
+}
+
+static const char *sse2_scan_ws(const char *s)
+{
+	SSE2_SCAN(s, 0xffff & ~_mm_movemask_epi8(_mm_or_si128(
+		_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+		sse2_range(v, '\t', '\r' - '\t'))));
+}
+
+static const char *sse2_scan_str(const char *s)
+{
+	SSE2_SCAN(s, _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(
+		_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+		_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+		sse2_range(v, 0, 0x1f))));
+}
+
+static const char *sse2_scan_chr(const char *s, int c)
+{
+	const __m128i vc = _mm_set1_epi8(c);
+
+	SSE2_SCAN(s, _mm_movemask_epi8(_mm_or_si128(
+		_mm_cmpeq_epi8(v, vc),
+		_mm_cmpeq_epi8(v, _mm_setzero_si128()))));
+}
+
+static const char *sse2_scan_ctrl(const char *s, size_t len)
+{
+	const char *end = s + len;
+	__m128i v;
+	unsigned int m;
+
+	for (; end - s >= 16; s += 16) {
+		v = _mm_loadu_si128((const __m128i *) s);
+		m = _mm_movemask_epi8(sse2_range(v, 0, 0x1f));
+		if (m) return s + __builtin_ctz(m);
+	}
+
+	return c_scan_ctrl(s, end - s);
+}
+
+static void sse2_scan_block(const char *s, struct scan_block *b)
+{
+	__m128i v, lc;
+	int i;
+
+	memset(b, 0, sizeof *b);
+	for (i = 0; i < 64; i += 16) {
+		v = _mm_loadu_si128((const __m128i *) (s + i));
+
+		/* '[' and ']' are '{' and '}' with bit 5 cleared */
+		lc = _mm_or_si128(v, _mm_set1_epi8(0x20));
+
+		b->bs    |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+		b->quote |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+		b->op    |= (uint64_t) _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(
+			_mm_cmpeq_epi8(lc, _mm_set1_epi8('{')),
+			_mm_cmpeq_epi8(lc, _mm_set1_epi8('}'))), _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8(','))))) << i;
+		b->ws    |= (uint64_t) _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			sse2_range(v, '\t', '\r' - '\t'))) << i;
+		b->ctrl  |= (uint64_t) _mm_movemask_epi8(sse2_range(v, 0, 0x1f)) << i;
+	}
+}
+
+/*****************************************************************************/
+/********************************** AVX2 *************************************/
+/*****************************************************************************/
+
+#define AVX2 __attribute__ ((target ("avx2")))
+
+#define AVX2_SCAN(s, MASK) do {                                   \
+	const char *p_ = ALIGN_DOWN(s, 32);                           \
+	__m256i v;                                                    \
+	uint32_t m_;                                                  \
+	v = _mm256_load_si256((const __m256i *) p_);                  \
+	m_ = (uint32_t) (MASK) >> (s - p_);                           \
+	if (m_) return s + __builtin_ctz(m_);                         \
+	for (;;) {                                                    \
+		p_ += 32;                                                 \
+		v = _mm256_load_si256((const __m256i *) p_);              \
+		m_ = (MASK);                                              \
+		if (m_) return p_ + __builtin_ctz(m_);                    \
+	}                                                             \
+} while (0)
+
+AVX2 static inline __m256i avx2_range(__m256i v, char lo, char n)
+{
+	__m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+	return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(n)), t);
+}
+
+AVX2 static const char *avx2_scan_ws(const char *s)
+{
+	AVX2_SCAN(s, ~(uint32_t) _mm256_movemask_epi8(_mm256_or_si256(
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+		avx2_range(v, '\t', '\r' - '\t'))));
+}
+
+AVX2 static const char *avx2_scan_str(const char *s)
+{
+	AVX2_SCAN(s, _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+		avx2_range(v, 0, 0x1f))));
+}
+
+AVX2 static const char *avx2_scan_chr(const char *s, int c)
+{
+	const __m256i vc = _mm256_set1_epi8(c);
+
+	AVX2_SCAN(s, _mm256_movemask_epi8(_mm256_or_si256(
+		_mm256_cmpeq_epi8(v, vc),
+		_mm256_cmpeq_epi8(v, _mm256_setzero_si256()))));
+}
+
+AVX2 static const char *avx2_scan_ctrl(const char *s, size_t len)
+{
+	const char *end = s + len;
+	__m256i v;
+	uint32_t m;
+
+	for (; end - s >= 32; s += 32) {
+		v = _mm256_loadu_si256((const __m256i *) s);
+		m = _mm256_movemask_epi8(avx2_range(v, 0, 0x1f));
+		if (m) return s + __builtin_ctz(m);
+	}
+
+	return sse2_scan_ctrl(s, end - s);
+}
+
+/** Movemask of 32 bytes as bits i..i+31 */
+#define AVX2_BITS(x, i) ((uint64_t) (uint32_t) _mm256_movemask_epi8(x) << (i))
+
+AVX2 static void avx2_scan_block(const char *s, struct scan_block *b)
+{
+	__m256i v, lc;
+	int i;
+
+	memset(b, 0, sizeof *b);
+	for (i = 0; i < 64; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *) (s + i));
+		lc = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+
+		b->bs    |= AVX2_BITS(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')), i);
+		b->quote |= AVX2_BITS(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), i);
+		b->op    |= AVX2_BITS(_mm256_or_si256(_mm256_or_si256(
+			_mm256_cmpeq_epi8(lc, _mm256_set1_epi8('{')),
+			_mm256_cmpeq_epi8(lc, _mm256_set1_epi8('}'))), _mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')))), i);
+		b->ws    |= AVX2_BITS(_mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+			avx2_range(v, '\t', '\r' - '\t')), i);
+		b->ctrl  |= AVX2_BITS(avx2_range(v, 0, 0x1f), i);
+	}
+}
+#endif /* SCAN_X86 */
+
+/*****************************************************************************/
+/******************************** Dispatch ***********************************/
+/*****************************************************************************/
+
+static const char *init_scan_ws(const char *s);
+static const char *init_scan_str(const char *s);
+static const char *init_scan_chr(const char *s, int c);
+static const char *init_scan_ctrl(const char *s, size_t len);
+
+static const char *(*scan_ws)(const char *s) = init_scan_ws;
+static const char *(*scan_str)(const char *s) = init_scan_str;
+static const char *(*scan_chr)(const char *s, int c) = init_scan_chr;
+static const char *(*scan_ctrl)(const char *s, size_t len) = init_scan_ctrl;
+static void (*scan_block)(const char *s, struct scan_block *b) = NULL;
+static const char *scan_impl = "c";
+
+/** Choose implementation for this CPU
+ * @note racing threads would just store the same pointers */
+static void scan_init(void)
+{
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		scan_ws   = avx2_scan_ws;
+		scan_str  = avx2_scan_str;
+		scan_chr  = avx2_scan_chr;
+		scan_ctrl = avx2_scan_ctrl;
+		scan_block = avx2_scan_block;
+		scan_impl = "avx2";
+	} else {
+		scan_ws   = sse2_scan_ws;
+		scan_str  = sse2_scan_str;
+		scan_chr  = sse2_scan_chr;
+		scan_ctrl = sse2_scan_ctrl;
+		scan_block = sse2_scan_block;
+		scan_impl = "sse2";
+	}
+#else
+	scan_ws   = c_scan_ws;
+	scan_str  = c_scan_str;
+	scan_chr  = c_scan_chr;
+	scan_ctrl = c_scan_ctrl;
+	scan_block = c_scan_block;
+#endif
+
+	dbg(8, "using %s\n", scan_impl);
+}
+
+static const char *init_scan_ws(const char *s)                { scan_init(); return scan_ws(s); }
+static const char *init_scan_str(const char *s)               { scan_init(); return scan_str(s); }
+static const char *init_scan_chr(const char *s, int c)        { scan_init(); return scan_chr(s, c); }
+static const char *init_scan_ctrl(const char *s, size_t len)  { scan_init(); return scan_ctrl(s, len); }
+
+const char *pjf_scan_ws(const char *s)                { return scan_ws(s); }
+const char *pjf_scan_str(const char *s)               { return scan_str(s); }
+const char *pjf_scan_chr(const char *s, int c)        { return scan_chr(s, c); }
+const char *pjf_scan_ctrl(const char *s, size_t len)  { return scan_ctrl(s, len); }
+
+const char *pjf_scan_impl(void)
+{
+	if (scan_ws == init_scan_ws) scan_init();
+	return scan_impl;
+}
+
+/*****************************************************************************/
+/********************************** Index ************************************/
+/*****************************************************************************/
+
+#define EVEN_BITS 0x5555555555555555ULL
+#define ODD_BITS  (~EVEN_BITS)
+
+/** Find characters escaped by a backslash: those right after an odd-length run of backslashes
+ * @param odd   1 if previous block ended with such a run; updated for the next block */
+static uint64_t escaped_bits(uint64_t bs, uint64_t *odd)
+{
+	uint64_t starts, even_starts, odd_starts, even_ends, odd_ends;
+	bool overflow;
+
+	/* a run starting at an even position has odd length if it ends at an odd one, and the other
+	 * way around - adding start bits to the run makes the carry ripple just past its end */
+	starts = bs & ~(bs << 1);
+	even_starts = starts & (EVEN_BITS ^ *odd);
+	odd_starts = starts & ~(EVEN_BITS ^ *odd);
+
+	even_ends = (bs + even_starts) & ~bs;
+	overflow = __builtin_add_overflow(bs, odd_starts, &odd_ends);
+	odd_ends = (odd_ends | *odd) & ~bs;
+
+	*odd = overflow;
+	return (even_ends & ODD_BITS) | (odd_ends & EVEN_BITS);
+}
+
+/** Bit i set if odd number of bits 0..i are set in x */
+static inline uint64_t prefix_xor(uint64_t x)
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+size_t pjf_scan_index(pjf_scan_state *st, const char *s, size_t len, uint32_t base, uint32_t *idx)
+{
+	struct scan_block b;
+	uint64_t quote, in, scalar, m;
+	uint32_t pos;
+	char tail[64];
+	size_t off, n = 0;
+	int i, cnt;
+
+	if (!scan_block)
+		scan_init();
+
+	for (off = 0; off < len; off += 64) {
+		if (len - off >= 64) {
+			scan_block(s + off, &b);
+		} else {
+			memset(tail, ' ', sizeof tail);
+			memcpy(tail, s + off, len - off);
+			scan_block(tail, &b);
+		}
+
+		/* in: from opening quote up to closing quote, exclusive */
+		quote = b.quote & ~escaped_bits(b.bs, &st->odd);
+		in = prefix_xor(quote) ^ st->in;
+		st->in = (uint64_t) ((int64_t) in >> 63);
+
+		/* bytes of numbers and literals - or garbage, which the parser will complain about */
+		scalar = ~(b.ws | b.op | quote | in);
+
+		m = quote
+		  | ((b.bs | b.ctrl) & in)                  /* slow cases in strings */
+		  | (b.op & ~in)
+		  | (scalar & ~((scalar << 1) | st->scalar)); /* first bytes of scalars */
+		st->scalar = scalar >> 63;
+
+		/* four at a time, even if fewer are left: cheaper than a mispredicted loop exit */
+		cnt = __builtin_popcountll(m);
+		pos = base + off;
+		for (i = 0; i < cnt; i += 4) {
+			idx[n + i]     = pos + __builtin_ctzll(m); m &= m - 1;
+			idx[n + i + 1] = pos + __builtin_ctzll(m | 1ULL << 63); m &= m - 1;
+			idx[n + i + 2] = pos + __builtin_ctzll(m | 1ULL << 63); m &= m - 1;
+			idx[n + i + 3] = pos + __builtin_ctzll(m | 1ULL << 63); m &= m - 1;
+		}
+		n += cnt;
+	}
+
+	return n;
+}
@@ -0,0 +1,82 @@
+/*
+ * scan - vectorized string scanning kernels
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file scan.h
+ * Find interesting characters in text 16 or 32 bytes at a time, using SSE2 or AVX2 - whichever
+ * the CPU supports, as detected on first call. Plain C is used on other architectures, and in
+ * builds with AddressSanitizer.
+ *
+ * @note functions working on \0-terminated strings may read past the terminator, but never past
+ *       the aligned block it lies in - so never into the next memory page
+ */
+
+/** True for whitespace skipped by pjf_scan_ws() */
+#define PJF_IS_WS(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+
+/** Skip whitespace: ' ', '\t', '\n', '\v', '\f', '\r'
+ * @return pointer to first other character, possibly the trailing \0 */
+const char *pjf_scan_ws(const char *s);
+
+/** Find first '"', '\\' or control character (< 0x20) - ie. the end of a run of plain JSON string
+ * @return pointer to the character found, possibly the trailing \0 */
+const char *pjf_scan_str(const char *s);
+
+/** Find first occurrence of c, like strchrnul()
+ * @return pointer to the character found or to the trailing \0 */
+const char *pjf_scan_chr(const char *s, int c);
+
+/** Find first control character (< 0x20) in len bytes of s
+ * @retval NULL  not found */
+const char *pjf_scan_ctrl(const char *s, size_t len);
+
+/** State of pjf_scan_index() carried from one part of text to the next - zero it at start */
+typedef struct pjf_scan_state {
+	uint64_t odd;     /** previous part ended with an odd number of backslashes */
+	uint64_t in;      /** all ones if previous part ended inside a string */
+	uint64_t scalar;  /** previous part ended inside a number or literal */
+} pjf_scan_state;
+
+/** Find tokens of JSON text, 64 bytes at a time
+ *
+ * Stores positions of: '{', '}', '[', ']', ':' and ',' outside strings; first bytes of numbers
+ * and literals; unescaped '"'; and '\\' and control characters inside strings. Thus the position
+ * after a token is followed by whitespace only up to the next position, and a string with no
+ * escapes ends at the position right after its opening quote.
+ *
+ * Long text may be indexed in parts, each a multiple of 64 bytes long except the last one.
+ *
+ * @param st    state, see pjf_scan_state
+ * @param base  position of s in the whole text, added to positions stored
+ * @param idx   room for len + 64 positions
+ * @return      number of positions stored
+ */
+size_t pjf_scan_index(pjf_scan_state *st, const char *s, size_t len, uint32_t base, uint32_t *idx);
+
+/** Name of the implementation in use: "avx2", "sse2" or "c" */
+const char *pjf_scan_impl(void);
+
+#endif /* _SCAN_H_ */
@@ -128,7 +128,6 @@ int pjf_cmd(const char *cmd, const char *args, thash *env, xstr *in, xstr *out,
 {
 	int rc = -1, e = 0, pin = 0, pout = 0, perr = 0;
 	pid_t child;
-	char buf[8192];
 
 	if (!(child = pjf_fork(cmd, args, env, &pin, &pout, &perr))) {
 		e = 1; dbg(2, "pjf_fork() failed\n");
@@ -137,15 +136,14 @@ int pjf_cmd(const char *cmd, const char *args, thash *env, xstr *in, xstr *out,
 
 	/* write stdin to child from in */
 	if (in) {
-		rc = write(pin, xstr_string(in), xstr_length(in));
+		rc = xstr_write_fd(in, pin);
 		CHECKRC2("write(pin)");
 	}
 	close(pin);
 
 	/* read stdout of child to out */
 	if (out) {
-		while ((rc = read(pout, buf, sizeof(buf))) > 0)
-			xstr_append_size(out, buf, rc);
+		rc = xstr_slurp_fd(out, pout);
 
 		CHECKRC2("read(pout)");
 		if (xstr_length(out)) dbg(6, "stdout: %s", xstr_string(out));
@@ -154,8 +152,7 @@ int pjf_cmd(const char *cmd, const char *args, thash *env, xstr *in, xstr *out,
 
 	/* read stderr of child to err */
 	if (err) {
-		while ((rc = read(perr, buf, sizeof(buf))) > 0)
-			xstr_append_size(err, buf, rc);
+		rc = xstr_slurp_fd(err, perr);
 
 		CHECKRC2("read(perr)");
 		if (xstr_length(err)) dbg(6, "stderr: %s", xstr_string(err));
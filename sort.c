@@ -0,0 +1,381 @@
+/*
+ * sort - sorting of arrays, tlists, strings and unitype lists
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "lib.h"
+
+/** Runs shorter than that are insertion-sorted before merging */
+#define SORT_RUN 8
+
+/** Below that size, multikey quicksort falls back to insertion sort */
+#define STRSORT_SMALL 12
+
+/*****************************************************************************/
+
+static void insertion_sort(char *base, size_t nmemb, size_t size, char *tmp,
+	int (*cmp)(const void *a, const void *b, void *arg), void *arg)
+{
+	size_t i, j;
+
+	for (i = 1; i < nmemb; i++) {
+		for (j = i; j > 0 && cmp(base + (j-1) * size, base + i * size, arg) > 0; j--);
+		if (j == i) continue;
+
+		memcpy(tmp, base + i * size, size);
+		memmove(base + (j+1) * size, base + j * size, (i - j) * size);
+		memcpy(base + j * size, tmp, size);
+	}
+}
+
+void pjf_sort_r(void *base, size_t nmemb, size_t size,
+	int (*cmp)(const void *a, const void *b, void *arg), void *arg)
+{
+	char *src = base, *dst, *tmp, *l, *le, *r, *re, *o;
+	size_t i, w, n;
+
+	if (nmemb < 2 || size == 0) return;
+
+	tmp = pjf_malloc(nmemb * size);
+
+	/* sort short runs first - tmp is free to use as a scratch element */
+	for (i = 0; i < nmemb; i += SORT_RUN)
+		insertion_sort(src + i * size, MIN(SORT_RUN, nmemb - i), size, tmp, cmp, arg);
+
+	/* merge runs bottom-up, bouncing between base and tmp */
+	dst = tmp;
+	for (w = SORT_RUN; w < nmemb; w *= 2) {
+		for (i = 0; i < nmemb; i += 2 * w) {
+			l  = src + i * size;
+			le = src + MIN(i + w, nmemb) * size;
+			r  = le;
+			re = src + MIN(i + 2 * w, nmemb) * size;
+			o  = dst + i * size;
+
+			/* take from the left run on ties - keeps the sort stable */
+			while (l < le && r < re) {
+				if (cmp(r, l, arg) < 0) {
+					memcpy(o, r, size);
+					r += size;
+				} else {
+					memcpy(o, l, size);
+					l += size;
+				}
+				o += size;
+			}
+
+			if (l < le) { n = le - l; memcpy(o, l, n); o += n; }
+			if (r < re) { n = re - r; memcpy(o, r, n); }
+		}
+
+		o = src; src = dst; dst = o;
+	}
+
+	if (src != base)
+		memcpy(base, src, nmemb * size);
+
+	free(tmp);
+}
+
+/*****************************************************************************/
+
+#define CH(i, d) ((unsigned char) a[i][d])
+#define SWAP(i, j) do { const char *t_ = a[i]; a[i] = a[j]; a[j] = t_; } while (0)
+
+static void vecswap(const char **a, long i, long j, long n)
+{
+	while (n-- > 0) { SWAP(i, j); i++; j++; }
+}
+
+/** Multikey quicksort by Bentley and Sedgewick, on strings at depth d */
+static void mkqsort(const char **a, long n, size_t d)
+{
+	long i, j, pa, pb, pc, pd, r;
+	int v, c;
+
+	while (n > 1) {
+		if (n < STRSORT_SMALL) {
+			for (i = 1; i < n; i++)
+				for (j = i; j > 0 && strcmp(a[j-1] + d, a[j] + d) > 0; j--)
+					SWAP(j, j-1);
+			return;
+		}
+
+		/* median of three as the pivot */
+		i = 0; j = n / 2; r = n - 1;
+		if (CH(i, d) > CH(j, d)) SWAP(i, j);
+		if (CH(j, d) > CH(r, d)) SWAP(j, r);
+		if (CH(i, d) > CH(j, d)) SWAP(i, j);
+		SWAP(0, j);
+		v = CH(0, d);
+
+		/* split into <, = and > parts, keeping the = ones at both ends for now */
+		pa = pb = 1;
+		pc = pd = n - 1;
+		for (;;) {
+			while (pb <= pc && (c = CH(pb, d) - v) <= 0) {
+				if (c == 0) { SWAP(pa, pb); pa++; }
+				pb++;
+			}
+			while (pb <= pc && (c = CH(pc, d) - v) >= 0) {
+				if (c == 0) { SWAP(pc, pd); pd--; }
+				pc--;
+			}
+			if (pb > pc) break;
+			SWAP(pb, pc);
+			pb++; pc--;
+		}
+
+		r = MIN(pa, pb - pa);      vecswap(a, 0, pb - r, r);
+		r = MIN(pd - pc, n-pd-1);  vecswap(a, pb, n - r, r);
+
+		mkqsort(a, pb - pa, d);
+		if (v != 0)
+			mkqsort(a + (pb - pa), pa + n - pd - 1, d + 1);
+
+		/* the > part: iterate instead of recursing */
+		r = pd - pc;
+		a += n - r;
+		n = r;
+	}
+}
+
+#undef CH
+#undef SWAP
+
+void pjf_strsort(const char **strs, size_t n)
+{
+	if (strs && n > 1)
+		mkqsort(strs, n, 0);
+}
+
+/*****************************************************************************/
+
+void tlist_sort_r(tlist *list, int (*cmp)(const void *a, const void *b, void *arg), void *arg)
+{
+	tlist_el *p, *q, *e, *head, *tail;
+	int insize, nmerges, psize, qsize;
+
+	if (!list || list->size < 2) return;
+
+	/* bottom-up merge sort on the list itself, by Simon Tatham */
+	head = list->head;
+	for (insize = 1;; insize *= 2) {
+		p = head;
+		head = tail = NULL;
+		nmerges = 0;
+
+		while (p) {
+			nmerges++;
+
+			/* step insize places along from p */
+			q = p;
+			for (psize = 0; q && psize < insize; psize++)
+				q = q->next;
+			qsize = insize;
+
+			/* merge the two runs, preferring p on ties */
+			while (psize > 0 || (qsize > 0 && q)) {
+				if (psize == 0) {
+					e = q; q = q->next; qsize--;
+				} else if (qsize == 0 || !q || cmp(p->val, q->val, arg) <= 0) {
+					e = p; p = p->next; psize--;
+				} else {
+					e = q; q = q->next; qsize--;
+				}
+
+				if (tail)
+					tail->next = e;
+				else
+					head = e;
+
+				e->prev = tail;
+				tail = e;
+			}
+
+			p = q;
+		}
+
+		tail->next = NULL;
+		if (nmerges <= 1) break;
+	}
+
+	list->head = head;
+	list->tail = tail;
+	tlist_reset(list);
+}
+
+struct cmp_wrap {
+	int (*cmp)(const void *a, const void *b);
+};
+
+static int call_cmp(const void *a, const void *b, void *arg)
+{
+	return ((struct cmp_wrap *) arg)->cmp(a, b);
+}
+
+void tlist_sort(tlist *list, int (*cmp)(const void *a, const void *b))
+{
+	struct cmp_wrap w = { cmp };
+	tlist_sort_r(list, call_cmp, &w);
+}
+
+void tlist_strsort(tlist *list)
+{
+	const char **strs;
+	tlist_el *el;
+	int i;
+
+	if (!list || list->size < 2) return;
+
+	strs = pjf_malloc(list->size * sizeof *strs);
+
+	for (i = 0, el = list->head; el; el = el->next)
+		strs[i++] = el->val;
+
+	pjf_strsort(strs, list->size);
+
+	for (i = 0, el = list->head; el; el = el->next)
+		el->val = (void *) strs[i++];
+
+	free(strs);
+}
+
+/*****************************************************************************/
+
+static int ut_rank(ut *var)
+{
+	if (!var) return 0;
+
+	switch (ut_type(var)) {
+		case T_NULL:   return 1;
+		case T_BOOL:
+		case T_INT:
+		case T_UINT:
+		case T_INT64:
+		case T_UINT64:
+		case T_DOUBLE: return 2;
+		case T_STRING: return 3;
+		default:       return 4;
+	}
+}
+
+/** Return value of integer or bool var, in two's complement if *neg is set */
+static uint64_t ut_u64(ut *var, bool *neg)
+{
+	*neg = false;
+
+	switch (var->type) {
+		case T_BOOL:   return var->d.as_bool;
+		case T_INT:    *neg = var->d.as_int < 0;   return (int64_t) var->d.as_int;
+		case T_UINT:   return var->d.as_uint;
+		case T_INT64:  *neg = var->d.as_int64 < 0; return var->d.as_int64;
+		case T_UINT64: return var->d.as_uint64;
+		default:       return 0;
+	}
+}
+
+int ut_cmp(ut *a, ut *b)
+{
+	int ra = ut_rank(a), rb = ut_rank(b);
+	uint64_t ua, ub;
+	bool na, nb;
+	double da, db;
+
+	if (ra != rb)
+		return ra - rb;
+
+	switch (ra) {
+		case 2:
+			if (a->type == T_DOUBLE || b->type == T_DOUBLE) {
+				da = ut_double(a);
+				db = ut_double(b);
+				return (da > db) - (da < db);
+			} else {
+				ua = ut_u64(a, &na);
+				ub = ut_u64(b, &nb);
+				if (na != nb)
+					return na ? -1 : 1;
+				return (ua > ub) - (ua < ub);
+			}
+		case 3:
+			return strcmp(xstr_string(a->d.as_xstr), xstr_string(b->d.as_xstr));
+		default:
+			return 0;
+	}
+}
+
+struct utl_sort_pair {
+	ut *key;
+	ut *val;
+};
+
+static int utl_sort_cmp(const void *a, const void *b, void *arg)
+{
+	return ut_cmp(((struct utl_sort_pair *) a)->key, ((struct utl_sort_pair *) b)->key);
+}
+
+ut *utl_sort_(ut *var, const char *key, ...)
+{
+	struct utl_sort_pair *pairs;
+	int i, j, nkeys = 0;
+	const char **keys, *k;
+	tlist *list;
+	tlist_el *el;
+	va_list args;
+	ut *node;
+
+	if (!ut_is_tlist(var)) return var;
+	list = var->d.as_tlist;
+	if (list->size < 2) return var;
+
+	/* count the keys first, so the path may be of any depth */
+	va_start(args, key);
+	for (k = key; k && *k; k = va_arg(args, const char *))
+		nkeys++;
+	va_end(args);
+
+	keys = pjf_malloc((nkeys + 1) * sizeof *keys);
+	va_start(args, key);
+	for (i = 0, k = key; i < nkeys; i++, k = va_arg(args, const char *))
+		keys[i] = k;
+	va_end(args);
+
+	/* decorate: look each key up once, not on every comparison */
+	pairs = pjf_malloc(list->size * sizeof *pairs);
+	for (i = 0, el = list->head; el; el = el->next, i++) {
+		node = el->val;
+		for (j = 0; node && j < nkeys; j++)
+			node = uth_get(node, keys[j]);
+
+		pairs[i].key = node;
+		pairs[i].val = el->val;
+	}
+
+	pjf_sort_r(pairs, list->size, sizeof *pairs, utl_sort_cmp, NULL);
+
+	for (i = 0, el = list->head; el; el = el->next)
+		el->val = pairs[i++].val;
+
+	free(pairs);
+	free(keys);
+	return var;
+}
@@ -0,0 +1,76 @@
+/*
+ * sort - sorting of arrays, tlists, strings and unitype lists
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SORT_H_
+#define _SORT_H_
+
+#include "tlist.h"
+#include "unitype.h"
+
+/** Stable in-place merge sort of an array
+ * @param base   array to sort
+ * @param nmemb  number of elements
+ * @param size   size of one element
+ * @param cmp    comparison function, like in qsort_r()
+ * @param arg    last argument to cmp
+ * @note uses a temporary buffer of nmemb * size bytes */
+void pjf_sort_r(void *base, size_t nmemb, size_t size,
+	int (*cmp)(const void *a, const void *b, void *arg), void *arg);
+
+/** Sort an array of strings in byte order
+ * Uses multikey quicksort, which inspects every character at most a few times instead of comparing
+ * whole strings again and again - much faster than qsort() + strcmp() on large sets with shared prefixes.
+ * @note not stable, but equal strings are indistinguishable anyway */
+void pjf_strsort(const char **strs, size_t n);
+
+/** Stable in-place merge sort of a tlist
+ * Elements are relinked, no memory is allocated. The list iterator is reset.
+ * @param list   list to sort
+ * @param cmp    comparison function, called with element values */
+void tlist_sort(tlist *list, int (*cmp)(const void *a, const void *b));
+
+/** tlist_sort() with an additional argument passed to cmp */
+void tlist_sort_r(tlist *list, int (*cmp)(const void *a, const void *b, void *arg), void *arg);
+
+/** Sort a tlist of strings in byte order
+ * @see pjf_strsort() */
+void tlist_strsort(tlist *list);
+
+/** Compare two unitype values
+ * Numbers (including bools) are compared by value, strings in byte order. Values of different kinds
+ * are ordered: NULL < null < numbers < strings < the rest.
+ * @retval <0  a < b
+ * @retval  0  a = b
+ * @retval >0  a > b */
+int ut_cmp(ut *a, ut *b);
+
+/** Stable sort of a unitype list
+ * Each element is compared by the value found under given key path (like in uth_path_get()), or by
+ * itself if the path is empty. Elements without the key go first.
+ * @param var    ut list
+ * @param key    first path chunk; give next keys in following arguments
+ * @note         last function argument must be NULL
+ * @return       var */
+ut *utl_sort_(ut *var, const char *key, ...);
+
+/** Wrapper of utl_sort_() which adds NULL as the last key */
+#define utl_sort(ut, ...) utl_sort_((ut), __VA_ARGS__, NULL)
+
+#endif /* _SORT_H_ */
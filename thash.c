@@ -301,6 +301,60 @@ void *thash_get(const thash *hash, const void *key)
 	return val;
 }
 
+/** True if \0-terminated k equals len bytes at s */
+static bool keyeq_len(const char *k, const char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (!k[i] || k[i] != s[i]) return false;
+
+	return k[len] == '\0';
+}
+
+/** Call fn on a \0-terminated copy of key */
+#define WITH_KEY_COPY(key, len, fn) do {                  \
+	char buf_[256], *k_ = buf_;                           \
+	if ((len) >= sizeof buf_) k_ = pjf_malloc((len) + 1); \
+	memcpy(k_, (key), (len));                             \
+	k_[(len)] = '\0';                                     \
+	fn;                                                   \
+	if (k_ != buf_) free(k_);                             \
+} while (0)
+
+void *thash_get_len(const thash *hash, const char *key, size_t len)
+{
+	return thash_get_hashed(hash, key, len, thash_str_hash_len(key, len));
+}
+
+void *thash_get_hashed(const thash *hash, const char *key, size_t len, unsigned int hval)
+{
+	thash_el *el;
+	void *val = NULL;
+
+	if (!hash) return NULL;
+
+	/* custom hashing - needs a real string, hval is useless */
+	if (hash->hash_func != thash_str_hash || hash->cmp_func != _thash_strcmp_wrapper) {
+		WITH_KEY_COPY(key, len, val = thash_get(hash, k_));
+		return val;
+	}
+
+	for (el = hash->tbl[hval % hash->size]; el; el = el->next) {
+		if (keyeq_len(el->key, key, len))
+			return el->val;
+	}
+
+	return NULL;
+}
+
+void thash_set_len(thash *hash, const char *key, size_t len, const void *val)
+{
+	if (!hash) return;
+
+	WITH_KEY_COPY(key, len, thash_set(hash, k_, val));
+}
+
 unsigned int thash_count(thash *hash)
 {
 	return hash ? hash->used : 0;
@@ -360,6 +414,17 @@ unsigned int thash_str_hash(const void *vkey)
 	return hash;
 }
 
+unsigned int thash_str_hash_len(const char *key, size_t len)
+{
+	unsigned int hash = 5381;
+	size_t i;
+
+	for (i = 0; i < len && key[i]; i++)
+		hash = ((hash << 5) + hash) + key[i];
+
+	return hash;
+}
+
 unsigned int thash_ptr_hash(const void *key)
 {
 	return ((unsigned long) key);
@@ -129,6 +129,15 @@ void thash_flush(thash *hash);
  * @retval NULL entry does not exist */
 void *thash_get(const thash *hash, const void *key);
 
+/** Like thash_get(), but for string keys given as len bytes at key, not \0-terminated
+ * @note applicable to string-keyed hashes only */
+void *thash_get_len(const thash *hash, const char *key, size_t len);
+
+/** Like thash_get_len(), but with key hash already computed
+ * @param hval  thash_str_hash_len(key, len) - used only if hash uses the default string hashing
+ * @note applicable to string-keyed hashes only */
+void *thash_get_hashed(const thash *hash, const char *key, size_t len, unsigned int hval);
+
 /** A thash_get in case values are of unsigned int type */
 #define thash_get_uint(a, b) ((unsigned long) thash_get((a), (b)))
 
@@ -168,6 +177,10 @@ void *_thash_iter(thash *hash, void **key);
  */
 void thash_set(thash *hash, const void *key, const void *val);
 
+/** Like thash_set(), but for string keys given as len bytes at key, not \0-terminated
+ * @note applicable to string-keyed hashes only */
+void thash_set_len(thash *hash, const char *key, size_t len, const void *val);
+
 /** A thash_set in case value is of unsigned int type */
 #define thash_set_uint(a, b, c) (thash_set((a), (b), ((const void *) (unsigned long) c)))
 
@@ -208,6 +221,9 @@ thash *thash_merge(thash *dst, thash *src);
  * @note by Daniel J. Bernstein */
 unsigned int thash_str_hash(const void *vkey);
 
+/** thash_str_hash() on len bytes at key */
+unsigned int thash_str_hash_len(const char *key, size_t len);
+
 /** Simplest possible pointer "hashing" function
  * @note just casts the pointer */
 unsigned int thash_ptr_hash(const void *key);
@@ -19,9 +19,95 @@
  */
 
 #include <stdarg.h>
+#include <limits.h>
+#include <pthread.h>
 #include "lib.h"
 
-#define mm var
+/* Extra data of nodes is kept out of line, so that struct ut stays 16 bytes: a node which has it is
+ * marked with the aux bit, and the data lives in a side table of its memory manager - which frees
+ * both together. Array slots never have extra data. */
+
+/** Extra data of a ut */
+struct ut_aux {
+	/** UT_MEMO* flags */
+	uint32_t memo;
+
+	/** Cached conversions, valid if respective flag is set in memo */
+	xstr *str;
+	int as_int;
+	uint32_t as_uint;
+	int64_t as_int64;
+	uint64_t as_uint64;
+	double as_double;
+
+	/** Number of references besides the first one, see ut_ref() */
+	uint32_t refs;
+
+	/** Cached ut_hash() */
+	uint64_t hash;
+};
+
+#define UT_MEMO        0x01  /** caching of conversions enabled */
+#define UT_MEMO_STR    0x02  /** str is valid */
+#define UT_MEMO_INT    0x04  /** as_int is valid */
+#define UT_MEMO_UINT   0x08  /** as_uint is valid */
+#define UT_MEMO_DOUBLE 0x10  /** as_double is valid */
+#define UT_MEMO_HASH   0x20  /** hash is valid */
+#define UT_MEMO_INT64  0x40  /** as_int64 is valid */
+#define UT_MEMO_UINT64 0x80  /** as_uint64 is valid */
+
+/** Read UT_MEMO* flags of aux - a set flag makes its field safe to read, see ut_memo_put() */
+#define MEMO_FLAGS(aux) __atomic_load_n(&(aux)->memo, __ATOMIC_ACQUIRE)
+
+/** Side table of a memory manager */
+struct ut_auxtbl {
+	pthread_mutex_t lock;  /** readers of shared nodes may come from other threads */
+	thash *tbl;            /** ut * -> struct ut_aux * */
+};
+
+static struct ut_aux *ut_aux(ut *var, bool create);
+static void ut_aux_drop(ut *var);
+static void ut_memo_put(ut *var, struct ut_aux *aux, struct ut_aux *val, uint32_t flag);
+
+/** True if var has caching enabled */
+#define MEMO_ON(var) (ut_memo_aux(var, false) != NULL)
+
+/** Evaluate expr, or if var caches conversions: only the first time, then return field
+ * @note needs struct ut_aux *aux, val in scope */
+#define MEMO(var, flag, field, expr) (!(aux = ut_memo_aux(var, true)) ? (expr) : \
+	(MEMO_FLAGS(aux) & (flag)) ? aux->field :                                    \
+	(val.field = (expr), ut_memo_put(var, aux, &val, (flag)), aux->field))
+
+/** True if var holds other values - anything computed from it depends on them, and they may change
+ * without var noticing, so such results are never cached */
+static inline bool ut_is_container(ut *var)
+{
+	switch (var->type) {
+		case T_LIST:
+		case T_HASH:
+		case T_ARRAY:
+		case T_VECTOR:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/** Return extra data of var if it has caching enabled, or NULL
+ * @param conv   if true, return NULL for containers, whose conversions are never cached */
+static inline struct ut_aux *ut_memo_aux(ut *var, bool conv)
+{
+	struct ut_aux *aux;
+
+	if (!var->aux || (conv && ut_is_container(var)))
+		return NULL;
+
+	aux = ut_aux(var, false);
+	return (aux && (MEMO_FLAGS(aux) & UT_MEMO)) ? aux : NULL;
+}
+
+/* allocate related memory next to var */
+#define mm ut_mm(var)
 
 bool   ut_bool(ut *var)
 {
@@ -29,10 +115,12 @@ bool   ut_bool(ut *var)
 
 	if (!var) return false;
 
-	switch (var->type) {
+	switch (ut_type(var)) {
 		case T_BOOL:   return var->d.as_bool;
 		case T_INT:    return (bool) var->d.as_int;
 		case T_UINT:   return (bool) var->d.as_uint;
+		case T_INT64:  return (bool) var->d.as_int64;
+		case T_UINT64: return (bool) var->d.as_uint64;
 		case T_DOUBLE: return (bool) var->d.as_double;
 		case T_STRING:
 			s = ut_char(var);
@@ -42,84 +130,197 @@ bool   ut_bool(ut *var)
 				return (bool) ut_int(var);
 		case T_LIST:   return (tlist_count(var->d.as_tlist) > 0);
 		case T_HASH:   return (thash_count(var->d.as_thash) > 0);
+		case T_ARRAY:  return (var->d.as_array->n > 0);
+		case T_BYTES:  return (var->d.as_bytes->len > 0);
+		case T_VECTOR: return (var->d.as_vector->n > 0);
 		default:       return false;
 	}
 }
 
 int    ut_int(ut *var)
 {
+	struct ut_aux *aux, val;
+
 	if (!var) return 0;
 
-	switch (var->type) {
+	switch (ut_type(var)) {
 		case T_INT:    return var->d.as_int;
 		case T_UINT:   return (int) var->d.as_uint;
+		case T_INT64:  return (int) var->d.as_int64;
+		case T_UINT64: return (int) var->d.as_uint64;
 		case T_DOUBLE: return (int) var->d.as_double;
-		case T_STRING: return atoi(xstr_string(var->d.as_xstr));
+		case T_STRING: return MEMO(var, UT_MEMO_INT, as_int, atoi(xstr_string(var->d.as_xstr)));
 		default: return 0;
 	}
 }
 
 uint32_t ut_uint(ut *var)
 {
+	struct ut_aux *aux, val;
+
 	if (!var) return 0;
 
-	switch (var->type) {
+	switch (ut_type(var)) {
 		case T_UINT:   return var->d.as_uint;
 		case T_INT:    return (uint32_t) var->d.as_int;
+		case T_INT64:  return (uint32_t) var->d.as_int64;
+		case T_UINT64: return (uint32_t) var->d.as_uint64;
 		case T_DOUBLE: return (uint32_t) var->d.as_double;
-		case T_STRING: return strtoul(xstr_string(var->d.as_xstr), NULL, 10);
+		case T_STRING: return MEMO(var, UT_MEMO_UINT, as_uint, strtoul(xstr_string(var->d.as_xstr), NULL, 10));
+		default: return 0;
+	}
+}
+
+int64_t ut_int64(ut *var)
+{
+	struct ut_aux *aux, val;
+
+	if (!var) return 0;
+
+	switch (ut_type(var)) {
+		case T_INT64:  return var->d.as_int64;
+		case T_UINT64: return (int64_t) var->d.as_uint64;
+		case T_INT:    return var->d.as_int;
+		case T_UINT:   return var->d.as_uint;
+		case T_DOUBLE: return (int64_t) var->d.as_double;
+		case T_STRING: return MEMO(var, UT_MEMO_INT64, as_int64, strtoll(xstr_string(var->d.as_xstr), NULL, 10));
+		default: return 0;
+	}
+}
+
+uint64_t ut_uint64(ut *var)
+{
+	struct ut_aux *aux, val;
+
+	if (!var) return 0;
+
+	switch (ut_type(var)) {
+		case T_UINT64: return var->d.as_uint64;
+		case T_INT64:  return (uint64_t) var->d.as_int64;
+		case T_UINT:   return var->d.as_uint;
+		case T_INT:    return (uint64_t) var->d.as_int;
+		case T_DOUBLE: return (uint64_t) var->d.as_double;
+		case T_STRING: return MEMO(var, UT_MEMO_UINT64, as_uint64, strtoull(xstr_string(var->d.as_xstr), NULL, 10));
 		default: return 0;
 	}
 }
 
 double ut_double(ut *var)
 {
+	struct ut_aux *aux, val;
+
 	if (!var) return 0.0;
 
-	switch (var->type) {
+	switch (ut_type(var)) {
 		case T_DOUBLE: return var->d.as_double;
 		case T_INT:    return (double) var->d.as_int;
 		case T_UINT:   return (double) var->d.as_uint;
-		case T_STRING: return strtod(xstr_string(var->d.as_xstr), NULL);
+		case T_INT64:  return (double) var->d.as_int64;
+		case T_UINT64: return (double) var->d.as_uint64;
+		case T_STRING: return MEMO(var, UT_MEMO_DOUBLE, as_double, strtod(xstr_string(var->d.as_xstr), NULL));
 		default: return 0.0;
 	}
 }
 
-xstr  *ut_xstr(ut *var)
+/** Append text representation of var to xs
+ * Nested lists and hashes are written straight into xs, without building own strings first */
+static void ut_xstr_append(xstr *xs, ut *var)
 {
-	if (!var) return NULL;
-
-	char buf[BUFSIZ], *key;
-	xstr *xs;
-	ut *el;
+	char *key;
+	xstr *str;
+	uint32_t i;
+	ut *el, tmp;
 
-	switch (var->type) {
+	switch (ut_type(var)) {
 		case T_STRING:
-			return var->d.as_xstr;
+			xstr_append_size(xs, xstr_string(var->d.as_xstr), xstr_length(var->d.as_xstr));
+			break;
+		case T_BYTES:
+			xstr_append_size(xs, var->d.as_bytes->s, var->d.as_bytes->len);
+			break;
 		case T_INT:
-			snprintf(buf, sizeof buf, "%d", var->d.as_int);
-			return MMXSTR_CREATE(buf);
+			xstr_append_int(xs, var->d.as_int);
+			break;
 		case T_UINT:
-			snprintf(buf, sizeof buf, "%u", var->d.as_uint);
-			return MMXSTR_CREATE(buf);
+			xstr_append_uint(xs, var->d.as_uint);
+			break;
+		case T_INT64:
+			xstr_append_int(xs, var->d.as_int64);
+			break;
+		case T_UINT64:
+			xstr_append_uint(xs, var->d.as_uint64);
+			break;
 		case T_DOUBLE:
-			snprintf(buf, sizeof buf, "%g", var->d.as_double);
-			return MMXSTR_CREATE(buf);
+			xstr_append_double(xs, var->d.as_double);
+			break;
 		case T_LIST:
-			xs = MMXSTR_CREATE("");
 			tlist_iter_loop(var->d.as_tlist, el) {
-				xstr_append(xs, ut_char(el));
+				ut_xstr_append(xs, el);
 				xstr_append_char(xs, ' ');
 			}
-			return xs;
+			break;
+		case T_ARRAY:
+			uta_iter_loop(var, i, el) {
+				ut_xstr_append(xs, el);
+				xstr_append_char(xs, ' ');
+			}
+			break;
+		case T_VECTOR:
+			for (i = 0; (el = utv_get(var, i, &tmp)); i++) {
+				ut_xstr_append(xs, el);
+				xstr_append_char(xs, ' ');
+			}
+			break;
 		case T_HASH:
-			xs = MMXSTR_CREATE("");
 			thash_iter_loop(var->d.as_thash, key, el) {
 				xstr_append(xs, key);
 				xstr_append(xs, ": ");
-				xstr_append(xs, ut_char(el));
+				ut_xstr_append(xs, el);
 				xstr_append_char(xs, ' ');
 			}
+			break;
+		default:
+			str = ut_xstr(var);
+			xstr_append_size(xs, xstr_string(str), xstr_length(str));
+			if (!ut_memo_aux(var, true)) {
+				xstr_free(str);
+				mmatic_free(str);
+			}
+			break;
+	}
+}
+
+/** Convert var to new xstr */
+static xstr *ut_xstr_convert(ut *var)
+{
+	char buf[BUFSIZ];
+	xstr *xs;
+
+	switch (var->type) {
+		case T_STRING:
+			return var->d.as_xstr;
+		case T_INT:
+			pjf_itoa(var->d.as_int, buf);
+			return MMXSTR_CREATE(buf);
+		case T_UINT:
+			pjf_utoa(var->d.as_uint, buf);
+			return MMXSTR_CREATE(buf);
+		case T_INT64:
+			pjf_itoa(var->d.as_int64, buf);
+			return MMXSTR_CREATE(buf);
+		case T_UINT64:
+			pjf_utoa(var->d.as_uint64, buf);
+			return MMXSTR_CREATE(buf);
+		case T_DOUBLE:
+			pjf_dtoa(var->d.as_double, buf);
+			return MMXSTR_CREATE(buf);
+		case T_LIST:
+		case T_HASH:
+		case T_ARRAY:
+		case T_BYTES:
+		case T_VECTOR:
+			xs = MMXSTR_CREATE("");
+			ut_xstr_append(xs, var);
 			return xs;
 		case T_BOOL:
 			if (var->d.as_bool)
@@ -136,6 +337,18 @@ xstr  *ut_xstr(ut *var)
 	}
 }
 
+xstr *ut_xstr(ut *var)
+{
+	struct ut_aux *aux, val;
+
+	if (!var) return NULL;
+
+	if (ut_is_string(var))
+		return var->d.as_xstr;
+
+	return MEMO(var, UT_MEMO_STR, str, ut_xstr_convert(var));
+}
+
 const char *ut_char(ut *var)
 {
 	if (!var) return NULL;
@@ -143,17 +356,44 @@ const char *ut_char(ut *var)
 	return xstr_string(ut_xstr(var));
 }
 
+xstr_view ut_view(ut *var)
+{
+	if (!var) return xsv_size("", 0);
+
+	return xsv_xstr(ut_xstr(var));
+}
+
+xstr_view ut_bytes(ut *var)
+{
+	if (ut_is_bytes(var))
+		return xsv_size(var->d.as_bytes->s, var->d.as_bytes->len);
+
+	return ut_view(var);
+}
+
 tlist *ut_tlist(ut *var)
 {
 	if (!var) return NULL;
 
 	tlist *list;
 	char *key;
-	ut *el;
+	uint32_t i;
+	ut *el, tmp;
 
-	switch (var->type) {
+	switch (ut_type(var)) {
 		case T_LIST:
 			return var->d.as_tlist;
+		case T_VECTOR:
+			/* elements are not nodes - make some */
+			list = tlist_create(ut_free, mm);
+			for (i = 0; (el = utv_get(var, i, &tmp)); i++)
+				tlist_push(list, ut_copy(el, mm));
+			return list;
+		case T_ARRAY:
+			list = tlist_create(NULL, mm);
+			uta_iter_loop(var, i, el)
+				tlist_push(list, el);
+			return list;
 		case T_HASH:
 			list = tlist_create(NULL, mm);
 			thash_iter_loop(var->d.as_thash, key, el)
@@ -168,7 +408,7 @@ thash *ut_thash(ut *var)
 {
 	if (!var) return NULL;
 
-	switch (var->type) {
+	switch (ut_type(var)) {
 		case T_HASH:
 			return var->d.as_thash;
 		default:
@@ -180,13 +420,19 @@ void  *ut_ptr(ut *var)
 {
 	if (!var) return NULL;
 
-	switch (var->type) {
+	switch (ut_type(var)) {
 		case T_PTR:
 			return var->d.as_ptr;
 		case T_HASH:
 			return var->d.as_thash;
 		case T_LIST:
 			return var->d.as_tlist;
+		case T_ARRAY:
+			return var->d.as_array;
+		case T_BYTES:
+			return (void *) var->d.as_bytes->s;
+		case T_VECTOR:
+			return var->d.as_vector->v;
 		case T_STRING:
 			return var->d.as_xstr;
 		default:
@@ -217,11 +463,24 @@ int ut_errcode(ut *var)
 
 /****************************************************************/
 
-ut *ut_new_bool(bool val, void *mm)
+#undef mm
+
+static void ut_copy_data(ut *dst, ut *src, bool deep);
+
+static ut *ut_alloc(enum ut_type type, void *mm)
 {
 	ut *ret = mmatic_alloc(mm, sizeof(struct ut));
 
-	ret->type = T_BOOL;
+	ret->type = type;
+	ret->slot = 0;
+	ret->aux = 0;
+
+	return ret;
+}
+
+ut *ut_new_bool(bool val, void *mm)
+{
+	ut *ret = ut_alloc(T_BOOL, mm);
 	ret->d.as_bool= val;
 
 	return ret;
@@ -229,9 +488,7 @@ ut *ut_new_bool(bool val, void *mm)
 
 ut *ut_new_int(int val, void *mm)
 {
-	ut *ret = mmatic_alloc(mm, sizeof(struct ut));
-
-	ret->type = T_INT;
+	ut *ret = ut_alloc(T_INT, mm);
 	ret->d.as_int = val;
 
 	return ret;
@@ -239,19 +496,31 @@ ut *ut_new_int(int val, void *mm)
 
 ut *ut_new_uint(uint32_t val, void *mm)
 {
-	ut *ret = mmatic_alloc(mm, sizeof(struct ut));
-
-	ret->type = T_UINT;
+	ut *ret = ut_alloc(T_UINT, mm);
 	ret->d.as_uint = val;
 
 	return ret;
 }
 
-ut *ut_new_double(double val, void *mm)
+ut *ut_new_int64(int64_t val, void *mm)
 {
-	ut *ret = mmatic_alloc(mm, sizeof(struct ut));
+	ut *ret = ut_alloc(T_INT64, mm);
+	ret->d.as_int64 = val;
+
+	return ret;
+}
+
+ut *ut_new_uint64(uint64_t val, void *mm)
+{
+	ut *ret = ut_alloc(T_UINT64, mm);
+	ret->d.as_uint64 = val;
+
+	return ret;
+}
 
-	ret->type = T_DOUBLE;
+ut *ut_new_double(double val, void *mm)
+{
+	ut *ret = ut_alloc(T_DOUBLE, mm);
 	ret->d.as_double = val;
 
 	return ret;
@@ -262,11 +531,47 @@ ut *ut_new_char(const char *val, void *mm)
 	return ut_new_xstr(xstr_create(val ? val : "", mm), mm);
 }
 
-ut *ut_new_xstr(xstr *val, void *mm)
+ut *ut_new_view(xstr_view val, void *mm)
 {
-	ut *ret = mmatic_alloc(mm, sizeof(struct ut));
+	xstr *xs = xstr_create("", mm);
+
+	xstr_set_size(xs, val.s, val.len);
+	return ut_new_xstr(xs, mm);
+}
+
+/** Allocate T_BYTES ut, with len bytes for data if not ref */
+static ut *ut_alloc_bytes(size_t len, bool ref, void *mm)
+{
+	ut *ret = ut_alloc(T_BYTES, mm);
+
+	/* data goes right after the header, so it is freed with it */
+	ret->d.as_bytes = mmatic_alloc(mm, sizeof(struct ut_bytes) + (ref ? 0 : len));
+	ret->d.as_bytes->s = ref ? NULL : (const char *) (ret->d.as_bytes + 1);
+	ret->d.as_bytes->len = len;
+	ret->d.as_bytes->ref = ref;
+
+	return ret;
+}
+
+ut *ut_new_bytes(const void *data, size_t len, void *mm)
+{
+	ut *ret = ut_alloc_bytes(len, false, mm);
+
+	memcpy((char *) ret->d.as_bytes->s, data, len);
+	return ret;
+}
+
+ut *ut_new_bytes_ref(const void *data, size_t len, void *mm)
+{
+	ut *ret = ut_alloc_bytes(len, true, mm);
 
-	ret->type = T_STRING;
+	ret->d.as_bytes->s = data;
+	return ret;
+}
+
+ut *ut_new_xstr(xstr *val, void *mm)
+{
+	ut *ret = ut_alloc(T_STRING, mm);
 	ret->d.as_xstr = val ? val : MMXSTR_CREATE("");
 
 	return ret;
@@ -274,9 +579,7 @@ ut *ut_new_xstr(xstr *val, void *mm)
 
 ut *ut_new_uttlist(tlist *val, void *mm)
 {
-	ut *ret = mmatic_alloc(mm, sizeof(struct ut));
-
-	ret->type = T_LIST;
+	ut *ret = ut_alloc(T_LIST, mm);
 	ret->d.as_tlist = val ? val : tlist_create(ut_free, mm);
 
 	return ret;
@@ -293,9 +596,7 @@ ut *ut_new_tlist(tlist *val, void *mm)
 
 ut *ut_new_utthash(thash *val, void *mm)
 {
-	ut *ret = mmatic_alloc(mm, sizeof(struct ut));
-
-	ret->type = T_HASH;
+	ut *ret = ut_alloc(T_HASH, mm);
 	ret->d.as_thash = val ? val : thash_create_strkey(ut_free, mm);
 
 	return ret;
@@ -312,9 +613,7 @@ ut *ut_new_thash(thash *val, void *mm)
 
 ut *ut_new_ptr(void *val, void *mm)
 {
-	ut *ret = mmatic_alloc(mm, sizeof(struct ut));
-
-	ret->type = T_PTR;
+	ut *ret = ut_alloc(T_PTR, mm);
 	ret->d.as_ptr = val;
 
 	return ret;
@@ -322,18 +621,12 @@ ut *ut_new_ptr(void *val, void *mm)
 
 ut *ut_new_null(void *mm)
 {
-	ut *ret = mmatic_alloc(mm, sizeof(struct ut));
-
-	ret->type = T_NULL;
-
-	return ret;
+	return ut_alloc(T_NULL, mm);
 }
 
 ut *ut_new_err(int code, const char *msg, const char *data, void *mm)
 {
-	ut *ret = mmatic_alloc(mm, sizeof(struct ut));
-
-	ret->type = T_ERR;
+	ut *ret = ut_alloc(T_ERR, mm);
 	ret->d.as_err = mmatic_alloc(mm, sizeof(struct ut_err));
 
 	ret->d.as_err->code = code;
@@ -343,15 +636,61 @@ ut *ut_new_err(int code, const char *msg, const char *data, void *mm)
 	return ret;
 }
 
-void ut_free(void *utarg)
+ut *ut_new_lazy(ut *(*fn)(struct ut_lazy *lz), void (*free)(struct ut_lazy *lz),
+	void *arg, const void *data, void *mm)
 {
-	ut *ut = utarg;
+	ut *ret = ut_alloc(T_LAZY, mm);
+	ret->d.as_lazy = mmatic_alloc(mm, sizeof(struct ut_lazy));
+
+	ret->d.as_lazy->fn   = fn;
+	ret->d.as_lazy->free = free;
+	ret->d.as_lazy->arg  = arg;
+	ret->d.as_lazy->data = data;
+
+	return ret;
+}
+
+ut *ut_force(ut *var)
+{
+	struct ut_lazy *lz;
+	ut *val;
+
+	if (!var || var->type != T_LAZY)
+		return var;
+
+	lz = var->d.as_lazy;
+	val = lz->fn(lz);
+	if (lz->free) lz->free(lz);
+	mmatic_free(lz);
+
+	/* var stays the same node, as others may point at it - only its data changes */
+	if (val->slot || ut_shared(val)) {
+		ut_copy_data(var, val, false);
+	} else {
+		var->type = val->type;
+		var->d = val->d;
+		val->type = T_NULL;
+	}
+	ut_free(val);
+
+	if (MEMO_ON(var))
+		ut_memoize(var, true);
+
+	return var;
+}
+
+/** Free memory held by ut, but not ut itself */
+static void ut_free_data(ut *ut)
+{
+	uint32_t i;
 
 	switch (ut->type) {
 		case T_PTR:
 		case T_BOOL:
 		case T_INT:
 		case T_UINT:
+		case T_INT64:
+		case T_UINT64:
 		case T_DOUBLE:
 		case T_NULL:
 			break;
@@ -364,25 +703,82 @@ void ut_free(void *utarg)
 		case T_HASH:
 			thash_free(ut->d.as_thash);
 			break;
+		case T_ARRAY:
+			for (i = 0; i < ut->d.as_array->n; i++)
+				ut_free_data(&ut->d.as_array->v[i]);
+			if (ut->d.as_array->v)
+				mmatic_free(ut->d.as_array->v);
+			mmatic_free(ut->d.as_array);
+			break;
+		case T_BYTES:
+			mmatic_free(ut->d.as_bytes);
+			break;
+		case T_VECTOR:
+			if (ut->d.as_vector->v)
+				mmatic_free(ut->d.as_vector->v);
+			mmatic_free(ut->d.as_vector);
+			break;
+		case T_LAZY:
+			if (ut->d.as_lazy->free) ut->d.as_lazy->free(ut->d.as_lazy);
+			mmatic_free(ut->d.as_lazy);
+			break;
 		case T_ERR:
 			mmatic_free(ut->d.as_err);
 			break;
 	}
 
-	mmatic_free(ut);
+	if (ut->aux)
+		ut_aux_drop(ut);
+}
+
+void ut_free(void *utarg)
+{
+	ut *ut = utarg;
+	struct ut_aux *aux = ut_aux(ut, false);
+	uint32_t refs;
+
+	/* shared: drop a reference, unless it was the last one */
+	if (aux && __atomic_load_n(&aux->refs, __ATOMIC_ACQUIRE) > 0) {
+		refs = __atomic_fetch_sub(&aux->refs, 1, __ATOMIC_ACQ_REL);
+
+		/* the only owner left may change it again - see ut_hash() */
+		if (refs == 1 && ut_is_container(ut))
+			__atomic_and_fetch(&aux->memo, ~UT_MEMO_HASH, __ATOMIC_RELAXED);
+
+		if (refs > 0)
+			return;
+	}
+
+	ut_free_data(ut);
+
+	/* array slots are freed with the array - leave an empty one, so it isn't freed twice */
+	if (ut->slot)
+		ut->type = T_NULL;
+	else
+		mmatic_free(ut);
 }
 
 /****************************************************************/
 
+static ut *uta_push(ut *var);
+
 ut *uth_get(ut *var, const char *key)
 {
 	return (ut_is_thash(var) ? thash_get(var->d.as_thash, key) : NULL);
 }
 
+ut *uth_get_view(ut *var, xstr_view key)
+{
+	return (ut_is_thash(var) ? thash_get_len(var->d.as_thash, key.s, key.len) : NULL);
+}
+
 ut *uth_set(ut *var, const char *key, ut *val)
 {
-	if (ut_is_thash(var))
+	if (ut_is_thash(var)) {
 		thash_set(var->d.as_thash, key, val);
+		ut_invalidate(var);
+		if (MEMO_ON(var)) ut_memoize(val, true);
+	}
 	return val;
 }
 
@@ -395,8 +791,10 @@ ut *uth_set_null(ut *var, const char *key)
 
 	kvar = uth_get(var, key);
 	if (!ut_is_null(kvar)) {
-		return uth_set(var, key, ut_new_null(var));
+		return uth_set(var, key, ut_new_null(ut_mm(var)));
 	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
 		return kvar;
 	}
 }
@@ -410,8 +808,10 @@ ut *uth_set_bool(ut *var, const char *key, bool val)
 
 	kvar = uth_get(var, key);
 	if (!ut_is_bool(kvar)) {
-		return uth_set(var, key, ut_new_bool(val, var));
+		return uth_set(var, key, ut_new_bool(val, ut_mm(var)));
 	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
 		kvar->d.as_bool = val;
 		return kvar;
 	}
@@ -426,8 +826,10 @@ ut *uth_set_int(ut *var, const char *key, int val)
 
 	kvar = uth_get(var, key);
 	if (!ut_is_int(kvar)) {
-		return uth_set(var, key, ut_new_int(val, var));
+		return uth_set(var, key, ut_new_int(val, ut_mm(var)));
 	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
 		kvar->d.as_int = val;
 		return kvar;
 	}
@@ -442,13 +844,51 @@ ut *uth_set_uint(ut *var, const char *key, uint32_t val)
 
 	kvar = uth_get(var, key);
 	if (!ut_is_uint(kvar)) {
-		return uth_set(var, key, ut_new_uint(val, var));
+		return uth_set(var, key, ut_new_uint(val, ut_mm(var)));
 	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
 		kvar->d.as_uint = val;
 		return kvar;
 	}
 }
 
+ut *uth_set_int64(ut *var, const char *key, int64_t val)
+{
+	ut *kvar;
+
+	if (!ut_is_thash(var))
+		return NULL;
+
+	kvar = uth_get(var, key);
+	if (!ut_is_int64(kvar)) {
+		return uth_set(var, key, ut_new_int64(val, ut_mm(var)));
+	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
+		kvar->d.as_int64 = val;
+		return kvar;
+	}
+}
+
+ut *uth_set_uint64(ut *var, const char *key, uint64_t val)
+{
+	ut *kvar;
+
+	if (!ut_is_thash(var))
+		return NULL;
+
+	kvar = uth_get(var, key);
+	if (!ut_is_uint64(kvar)) {
+		return uth_set(var, key, ut_new_uint64(val, ut_mm(var)));
+	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
+		kvar->d.as_uint64 = val;
+		return kvar;
+	}
+}
+
 ut *uth_set_double(ut *var, const char *key, double val)
 {
 	ut *kvar;
@@ -458,8 +898,10 @@ ut *uth_set_double(ut *var, const char *key, double val)
 
 	kvar = uth_get(var, key);
 	if (!ut_is_double(kvar)) {
-		return uth_set(var, key, ut_new_double(val, var));
+		return uth_set(var, key, ut_new_double(val, ut_mm(var)));
 	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
 		kvar->d.as_double = val;
 		return kvar;
 	}
@@ -474,8 +916,10 @@ ut *uth_set_char(ut *var, const char *key, const char *val)
 
 	kvar = uth_get(var, key);
 	if (!ut_is_string(kvar)) {
-		return uth_set(var, key, ut_new_char(val, var));
+		return uth_set(var, key, ut_new_char(val, ut_mm(var)));
 	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
 		xstr_set(kvar->d.as_xstr, val ? val : "");
 		return kvar;
 	}
@@ -490,8 +934,10 @@ ut *uth_set_xstr(ut *var, const char *key, xstr *val)
 
 	kvar = uth_get(var, key);
 	if (!ut_is_string(kvar)) {
-		return uth_set(var, key, ut_new_xstr(val, var));
+		return uth_set(var, key, ut_new_xstr(val, ut_mm(var)));
 	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
 		if (val) {
 			xstr_free(kvar->d.as_xstr);
 			kvar->d.as_xstr = val;
@@ -511,8 +957,10 @@ ut *uth_set_tlist(ut *var, const char *key, tlist *val)
 
 	kvar = uth_get(var, key);
 	if (!ut_is_tlist(kvar)) {
-		return uth_set(var, key, ut_new_tlist(val, var));
+		return uth_set(var, key, ut_new_tlist(val, ut_mm(var)));
 	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
 		if (val) {
 			tlist_free(kvar->d.as_tlist);
 			kvar->d.as_tlist = val;
@@ -532,8 +980,10 @@ ut *uth_set_thash(ut *var, const char *key, thash *val)
 
 	kvar = uth_get(var, key);
 	if (!ut_is_thash(kvar)) {
-		return uth_set(var, key, ut_new_thash(val, var));
+		return uth_set(var, key, ut_new_thash(val, ut_mm(var)));
 	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
 		if (val) {
 			thash_free(kvar->d.as_thash);
 			kvar->d.as_thash = val;
@@ -553,8 +1003,10 @@ ut *uth_set_ptr(ut *var, const char *key, void *ptr)
 
 	kvar = uth_get(var, key);
 	if (!ut_is_ptr(kvar)) {
-		return uth_set(var, key, ut_new_ptr(ptr, var));
+		return uth_set(var, key, ut_new_ptr(ptr, ut_mm(var)));
 	} else {
+		ut_invalidate(kvar);
+		ut_invalidate(var);
 		kvar->d.as_ptr = ptr;
 		return kvar;
 	}
@@ -621,57 +1073,878 @@ ut *uth_path_create_(ut *parent, const char *key, ...)
 
 ut *utl_add(ut *var, ut *val)
 {
-	if (ut_is_tlist(var))
+	if (ut_is_tlist(var)) {
 		tlist_push(var->d.as_tlist, val);
+		if (MEMO_ON(var)) ut_memoize(val, true);
+	} else if (ut_is_array(var))
+		return uta_add(var, val);
+
+	ut_invalidate(var);
 	return val;
 }
 
+/** Store a scalar straight in a new array slot, without allocating a node first */
+#define UTA_ADD_SCALAR(var, t, field, val) do { \
+	if (ut_is_array(var)) {                      \
+		ut *el_ = uta_push(var);                 \
+		ut_invalidate(var);                      \
+		el_->type = (t);                         \
+		el_->d.field = (val);                    \
+		return el_;                              \
+	}                                            \
+} while (0)
+
 ut *utl_add_null(ut *var)
 {
-	return utl_add(var, ut_new_null(var));
+	if (ut_is_array(var)) {
+		ut_invalidate(var);
+		return uta_push(var);
+	}
+
+	return utl_add(var, ut_new_null(ut_mm(var)));
 }
 
 ut *utl_add_bool(ut *var, bool val)
 {
-	return utl_add(var, ut_new_bool(val, var));
+	UTA_ADD_SCALAR(var, T_BOOL, as_bool, val);
+	return utl_add(var, ut_new_bool(val, ut_mm(var)));
 }
 
 ut *utl_add_int(ut *var, int val)
 {
-	return utl_add(var, ut_new_int(val, var));
+	UTA_ADD_SCALAR(var, T_INT, as_int, val);
+	return utl_add(var, ut_new_int(val, ut_mm(var)));
 }
 
 ut *utl_add_uint(ut *var, uint32_t val)
 {
-	return utl_add(var, ut_new_uint(val, var));
+	UTA_ADD_SCALAR(var, T_UINT, as_uint, val);
+	return utl_add(var, ut_new_uint(val, ut_mm(var)));
+}
+
+ut *utl_add_int64(ut *var, int64_t val)
+{
+	UTA_ADD_SCALAR(var, T_INT64, as_int64, val);
+	return utl_add(var, ut_new_int64(val, ut_mm(var)));
+}
+
+ut *utl_add_uint64(ut *var, uint64_t val)
+{
+	UTA_ADD_SCALAR(var, T_UINT64, as_uint64, val);
+	return utl_add(var, ut_new_uint64(val, ut_mm(var)));
 }
 
 ut *utl_add_double(ut *var, double val)
 {
-	return utl_add(var, ut_new_double(val, var));
+	UTA_ADD_SCALAR(var, T_DOUBLE, as_double, val);
+	return utl_add(var, ut_new_double(val, ut_mm(var)));
 }
 
 ut *utl_add_char(ut *var, const char *val)
 {
-	return utl_add(var, ut_new_char(val, var));
+	return utl_add(var, ut_new_char(val, ut_mm(var)));
 }
 
 ut *utl_add_xstr(ut *var, xstr *val)
 {
-	return utl_add(var, ut_new_xstr(val, var));
+	return utl_add(var, ut_new_xstr(val, ut_mm(var)));
 }
 
 ut *utl_add_tlist(ut *var, tlist *val)
 {
-	return utl_add(var, ut_new_tlist(val, var));
+	return utl_add(var, ut_new_tlist(val, ut_mm(var)));
 }
 
 ut *utl_add_thash(ut *var, thash *val)
 {
-	return utl_add(var, ut_new_thash(val, var));
+	return utl_add(var, ut_new_thash(val, ut_mm(var)));
 }
 
 ut *utl_add_ptr(ut *var, void *ptr)
 {
-	return utl_add(var, ut_new_ptr(ptr, var));
+	UTA_ADD_SCALAR(var, T_PTR, as_ptr, ptr);
+	return utl_add(var, ut_new_ptr(ptr, ut_mm(var)));
+}
+
+/****************************************************************/
+
+ut *ut_new_array(uint32_t size, void *mm)
+{
+	ut *ret = ut_alloc(T_ARRAY, mm);
+
+	ret->d.as_array = mmatic_alloc(mm, sizeof(struct ut_array));
+	ret->d.as_array->n = 0;
+	ret->d.as_array->a = size;
+	ret->d.as_array->v = size ? mmatic_alloc(mm, size * sizeof(struct ut)) : NULL;
+
+	return ret;
+}
+
+uint32_t uta_count(ut *var)
+{
+	return ut_is_array(var) ? var->d.as_array->n : 0;
+}
+
+ut *uta_get(ut *var, uint32_t i)
+{
+	if (!ut_is_array(var) || i >= var->d.as_array->n)
+		return NULL;
+
+	return &var->d.as_array->v[i];
+}
+
+/** Append a T_NULL slot */
+static ut *uta_push(ut *var)
+{
+	struct ut_array *arr = var->d.as_array;
+	ut *el;
+
+	if (arr->n == arr->a) {
+		arr->a = arr->a ? 2 * arr->a : 8;
+
+		/* slots must begin their chunk - see ut_mm() */
+		if (arr->v)
+			arr->v = mmatic_resize(arr->v, arr->a * sizeof(struct ut));
+		else
+			arr->v = mmatic_alloc(ut_mm(var), arr->a * sizeof(struct ut));
+	}
+
+	el = &arr->v[arr->n++];
+	el->type = T_NULL;
+	el->slot = arr->n;
+	el->aux = 0;
+
+	return el;
+}
+
+/** Move val into slot el, which holds no data */
+static void uta_put(ut *el, ut *val)
+{
+	/* moving a slot would leave its data shared by two arrays */
+	pjf_assert(!val->slot);
+
+	/* val still used elsewhere: slot needs its own copy */
+	if (ut_shared(val)) {
+		ut_copy_data(el, val, false);
+		ut_free(val);
+		return;
+	}
+
+	/* slots have no extra data */
+	if (val->aux)
+		ut_aux_drop(val);
+
+	el->type = val->type;
+	el->d = val->d;
+
+	mmatic_free(val);
+}
+
+ut *uta_add(ut *var, ut *val)
+{
+	ut *el;
+
+	if (!ut_is_array(var))
+		return val;
+
+	el = uta_push(var);
+	ut_invalidate(var);
+	uta_put(el, val);
+	if (MEMO_ON(var)) ut_memoize(el, true);
+
+	return el;
+}
+
+ut *uta_set(ut *var, uint32_t i, ut *val)
+{
+	ut *el = uta_get(var, i);
+
+	if (!el)
+		return NULL;
+
+	ut_free_data(el);
+	ut_invalidate(var);
+	uta_put(el, val);
+
+	return el;
+}
+
+/** Move n slots from src to dst, keeping slot numbers right */
+static void uta_move(ut *var, uint32_t dst, uint32_t src, uint32_t n)
+{
+	ut *v = var->d.as_array->v;
+	uint32_t i;
+
+	memmove(&v[dst], &v[src], n * sizeof(struct ut));
+	for (i = dst; i < dst + n; i++)
+		v[i].slot = i + 1;
+}
+
+ut *uta_insert(ut *var, uint32_t i, ut *val)
+{
+	ut *el;
+
+	if (!ut_is_array(var) || i > var->d.as_array->n)
+		return NULL;
+
+	uta_push(var);
+	uta_move(var, i + 1, i, var->d.as_array->n - 1 - i);
+
+	el = &var->d.as_array->v[i];
+	el->type = T_NULL;
+	el->aux = 0;
+
+	ut_invalidate(var);
+	uta_put(el, val);
+
+	return el;
+}
+
+bool uta_remove(ut *var, uint32_t i)
+{
+	ut *el = uta_get(var, i);
+
+	if (!el)
+		return false;
+
+	ut_free_data(el);
+	uta_move(var, i, i + 1, var->d.as_array->n - 1 - i);
+	var->d.as_array->n--;
+
+	ut_invalidate(var);
+	return true;
+}
+
+/****************************************************************/
+
+/** Size of vector element */
+static size_t utv_size(enum ut_vtype type)
+{
+	return type == UTV_UINT32 ? sizeof(uint32_t) : sizeof(int64_t);
+}
+
+ut *ut_new_vector(enum ut_vtype type, uint32_t size, void *mm)
+{
+	ut *ret = ut_alloc(T_VECTOR, mm);
+
+	ret->d.as_vector = mmatic_alloc(mm, sizeof(struct ut_vector));
+	ret->d.as_vector->type = type;
+	ret->d.as_vector->n = 0;
+	ret->d.as_vector->a = size;
+	ret->d.as_vector->v = size ? mmatic_alloc(mm, size * utv_size(type)) : NULL;
+
+	return ret;
+}
+
+enum ut_vtype utv_type(ut *var)
+{
+	return ut_is_vector(var) ? var->d.as_vector->type : 0;
+}
+
+uint32_t utv_count(ut *var)
+{
+	return ut_is_vector(var) ? var->d.as_vector->n : 0;
+}
+
+/** Return elements of var if it is a vector of given type */
+static void *utv_raw(ut *var, enum ut_vtype type, uint32_t *n)
+{
+	if (utv_type(var) != type)
+		return NULL;
+
+	if (n) *n = var->d.as_vector->n;
+	return var->d.as_vector->v;
+}
+
+int64_t *utv_int64(ut *var, uint32_t *n)
+{
+	return utv_raw(var, UTV_INT64, n);
+}
+
+uint32_t *utv_uint32(ut *var, uint32_t *n)
+{
+	return utv_raw(var, UTV_UINT32, n);
+}
+
+double *utv_double(ut *var, uint32_t *n)
+{
+	return utv_raw(var, UTV_DOUBLE, n);
+}
+
+/** Make room for one more element and return its index */
+static uint32_t utv_push(ut *var)
+{
+	struct ut_vector *vec = var->d.as_vector;
+
+	if (vec->n == vec->a) {
+		vec->a = vec->a ? 2 * vec->a : 16;
+
+		if (vec->v)
+			vec->v = mmatic_resize(vec->v, vec->a * utv_size(vec->type));
+		else
+			vec->v = mmatic_alloc(ut_mm(var), vec->a * utv_size(vec->type));
+	}
+
+	ut_invalidate(var);
+	return vec->n++;
+}
+
+bool utv_add_int64(ut *var, int64_t val)
+{
+	uint32_t i;
+
+	if (!ut_is_vector(var))
+		return false;
+
+	i = utv_push(var);
+	switch (var->d.as_vector->type) {
+		case UTV_INT64:  ((int64_t *) var->d.as_vector->v)[i] = val; break;
+		case UTV_UINT32: ((uint32_t *) var->d.as_vector->v)[i] = val; break;
+		case UTV_DOUBLE: ((double *) var->d.as_vector->v)[i] = val; break;
+	}
+
+	return true;
+}
+
+bool utv_add_double(ut *var, double val)
+{
+	uint32_t i;
+
+	if (!ut_is_vector(var))
+		return false;
+
+	i = utv_push(var);
+	switch (var->d.as_vector->type) {
+		case UTV_INT64:  ((int64_t *) var->d.as_vector->v)[i] = val; break;
+		case UTV_UINT32: ((uint32_t *) var->d.as_vector->v)[i] = val; break;
+		case UTV_DOUBLE: ((double *) var->d.as_vector->v)[i] = val; break;
+	}
+
+	return true;
+}
+
+ut *utv_get(ut *var, uint32_t i, ut *tmp)
+{
+	int64_t v;
+
+	if (i >= utv_count(var))
+		return NULL;
+
+	tmp->slot = 0;
+	tmp->aux = 0;
+
+	switch (var->d.as_vector->type) {
+		case UTV_INT64:
+			v = ((int64_t *) var->d.as_vector->v)[i];
+			if (v >= INT_MIN && v <= INT_MAX) {
+				tmp->type = T_INT;
+				tmp->d.as_int = v;
+			} else {
+				tmp->type = T_INT64;
+				tmp->d.as_int64 = v;
+			}
+			break;
+		case UTV_UINT32:
+			tmp->type = T_UINT;
+			tmp->d.as_uint = ((uint32_t *) var->d.as_vector->v)[i];
+			break;
+		case UTV_DOUBLE:
+			tmp->type = T_DOUBLE;
+			tmp->d.as_double = ((double *) var->d.as_vector->v)[i];
+			break;
+	}
+
+	return tmp;
+}
+
+/****************************************************************/
+
+/** Return extra data of var
+ * @param create   if var has none: if true, create it, else return NULL */
+static struct ut_aux *ut_aux(ut *var, bool create)
+{
+	struct ut_auxtbl *t;
+	struct ut_aux *aux;
+	mmatic *mgr;
+
+	if (!var->aux && !create)
+		return NULL;
+
+	pjf_assert(!var->slot);
+	mgr = mmatic_mgr(var);
+
+	/* the table is created by the thread owning the manager, before any node is marked */
+	if (!mgr->utaux) {
+		t = mmatic_alloc(mgr, sizeof *t);
+		pthread_mutex_init(&t->lock, NULL);
+		t->tbl = thash_create_ptrkey(NULL, mgr);
+		mgr->utaux = t;
+	}
+	t = mgr->utaux;
+
+	pthread_mutex_lock(&t->lock);
+	aux = thash_get(t->tbl, var);
+
+	if (!var->aux) {
+		/* a left-over of a node freed without ut_free() at the same address */
+		if (aux)
+			memset(aux, 0, sizeof *aux);
+		else
+			thash_set(t->tbl, var, (aux = mmatic_zalloc(mgr, sizeof *aux)));
+
+		var->aux = 1;
+	}
+	pthread_mutex_unlock(&t->lock);
+
+	return aux;
+}
+
+/** Free extra data of var */
+static void ut_aux_drop(ut *var)
+{
+	struct ut_auxtbl *t = mmatic_mgr(var)->utaux;
+	struct ut_aux *aux;
+
+	ut_invalidate(var);
+
+	pthread_mutex_lock(&t->lock);
+	aux = thash_get(t->tbl, var);
+	thash_set(t->tbl, var, NULL);
+	pthread_mutex_unlock(&t->lock);
+
+	mmatic_free(aux);
+	var->aux = 0;
+}
+
+/** Cache value of flag, computed in the same field of val - unless another reader of a shared var
+ * did it first. Fields are written before their flags, and under the lock, so readers which see
+ * a flag set also see its field. */
+static void ut_memo_put(ut *var, struct ut_aux *aux, struct ut_aux *val, uint32_t flag)
+{
+	struct ut_auxtbl *t = mmatic_mgr(var)->utaux;
+
+	pthread_mutex_lock(&t->lock);
+	if (MEMO_FLAGS(aux) & flag) {
+		/* lost the race: keep the first value */
+		if (flag == UT_MEMO_STR) {
+			xstr_free(val->str);
+			mmatic_free(val->str);
+		}
+	} else {
+		switch (flag) {
+			case UT_MEMO_STR:    aux->str       = val->str;       break;
+			case UT_MEMO_INT:    aux->as_int    = val->as_int;    break;
+			case UT_MEMO_UINT:   aux->as_uint   = val->as_uint;   break;
+			case UT_MEMO_INT64:  aux->as_int64  = val->as_int64;  break;
+			case UT_MEMO_UINT64: aux->as_uint64 = val->as_uint64; break;
+			case UT_MEMO_DOUBLE: aux->as_double = val->as_double; break;
+			case UT_MEMO_HASH:   aux->hash      = val->hash;      break;
+		}
+		__atomic_or_fetch(&aux->memo, flag, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&t->lock);
+}
+
+void ut_memoize(ut *var, bool on)
+{
+	struct ut_aux *aux;
+	char *key;
+	uint32_t i;
+	ut *el;
+
+	if (!var) return;
+
+	/* slots have no extra data, but their children may */
+	if (var->slot) {
+		/* nothing to do */
+	} else if (on) {
+		__atomic_or_fetch(&ut_aux(var, true)->memo, UT_MEMO, __ATOMIC_RELAXED);
+	} else if ((aux = ut_aux(var, false))) {
+		ut_invalidate(var);
+		__atomic_store_n(&aux->memo, 0, __ATOMIC_RELAXED);
+	}
+
+	switch (var->type) {
+		case T_LIST:
+			tlist_iter_loop(var->d.as_tlist, el) ut_memoize(el, on);
+			break;
+		case T_HASH:
+			thash_iter_loop(var->d.as_thash, key, el) ut_memoize(el, on);
+			break;
+		case T_ARRAY:
+			uta_iter_loop(var, i, el) ut_memoize(el, on);
+			break;
+		default:
+			break;
+	}
+}
+
+void ut_invalidate(ut *var)
+{
+	struct ut_aux *aux;
+
+	if (!var || !(aux = ut_aux(var, false))) return;
+
+	if (MEMO_FLAGS(aux) & UT_MEMO_STR) {
+		xstr_free(aux->str);
+		mmatic_free(aux->str);
+		aux->str = NULL;
+	}
+
+	__atomic_and_fetch(&aux->memo, UT_MEMO, __ATOMIC_RELAXED);
+}
+
+/****************************************************************/
+
+ut *ut_ref(ut *var)
+{
+	if (!var) return NULL;
+
+	/* slots live inside their array - can't outlive it */
+	pjf_assert(!var->slot);
+
+	__atomic_add_fetch(&ut_aux(var, true)->refs, 1, __ATOMIC_RELAXED);
+	return var;
+}
+
+bool ut_shared(ut *var)
+{
+	struct ut_aux *aux;
+
+	return var && (aux = ut_aux(var, false)) && __atomic_load_n(&aux->refs, __ATOMIC_ACQUIRE) > 0;
+}
+
+/** Child of a copy: clone of el if deep, el itself otherwise */
+#define COPY_CHILD(el, mm, deep) ((deep) ? ut_clone((el), (mm)) : ut_ref(el))
+
+/** Fill dst, which holds no data, with contents of src
+ * Children are cloned if deep, referenced otherwise. Array slots are always copied, as they can't
+ * be referenced - but their children follow the same rule. */
+static void ut_copy_data(ut *dst, ut *src, bool deep)
+{
+	void *mm = ut_mm(dst);
+	struct ut_bytes *bytes;
+	struct ut_array *arr;
+	char *key;
+	uint32_t i;
+	ut *el;
+
+	ut_force(src);
+	dst->type = src->type;
+
+	switch (src->type) {
+		case T_STRING:
+			dst->d.as_xstr = xstr_create("", mm);
+			xstr_set_size(dst->d.as_xstr, xstr_string(src->d.as_xstr), xstr_length(src->d.as_xstr));
+			break;
+		case T_LIST:
+			dst->d.as_tlist = tlist_create(ut_free, mm);
+			tlist_iter_loop(src->d.as_tlist, el)
+				tlist_push(dst->d.as_tlist, COPY_CHILD(el, mm, deep));
+			break;
+		case T_HASH:
+			dst->d.as_thash = thash_create_strkey(ut_free, mm);
+			thash_iter_loop(src->d.as_thash, key, el)
+				thash_set(dst->d.as_thash, key, COPY_CHILD(el, mm, deep));
+			break;
+		case T_ARRAY:
+			arr = mmatic_alloc(mm, sizeof(struct ut_array));
+			arr->n = arr->a = src->d.as_array->n;
+			arr->v = arr->n ? mmatic_alloc(mm, arr->n * sizeof(struct ut)) : NULL;
+			dst->d.as_array = arr;
+
+			for (i = 0; i < arr->n; i++) {
+				el = &arr->v[i];
+				el->slot = i + 1;
+				el->aux = 0;
+				ut_copy_data(el, &src->d.as_array->v[i], deep);
+			}
+			break;
+		case T_BYTES:
+			/* referenced data stays referenced */
+			bytes = src->d.as_bytes;
+			dst->d.as_bytes = mmatic_alloc(mm, sizeof(struct ut_bytes) + (bytes->ref ? 0 : bytes->len));
+			*dst->d.as_bytes = *bytes;
+			if (!bytes->ref) {
+				dst->d.as_bytes->s = (const char *) (dst->d.as_bytes + 1);
+				memcpy(dst->d.as_bytes + 1, bytes->s, bytes->len);
+			}
+			break;
+		case T_VECTOR:
+			dst->d.as_vector = mmatic_alloc(mm, sizeof(struct ut_vector));
+			*dst->d.as_vector = *src->d.as_vector;
+			dst->d.as_vector->a = src->d.as_vector->n;
+			dst->d.as_vector->v = NULL;
+			if (src->d.as_vector->n) {
+				dst->d.as_vector->v = mmatic_alloc(mm, src->d.as_vector->n * utv_size(src->d.as_vector->type));
+				memcpy(dst->d.as_vector->v, src->d.as_vector->v, src->d.as_vector->n * utv_size(src->d.as_vector->type));
+			}
+			break;
+		case T_ERR:
+			dst->d.as_err = mmatic_alloc(mm, sizeof(struct ut_err));
+			*dst->d.as_err = *src->d.as_err;
+			break;
+		default:
+			dst->d = src->d;
+			break;
+	}
+}
+
+ut *ut_copy(ut *var, void *mm)
+{
+	ut *ret;
+
+	if (!var) return NULL;
+
+	ret = ut_alloc(ut_type(var), mm);
+	ut_copy_data(ret, var, false);
+
+	return ret;
+}
+
+ut *ut_clone(ut *var, void *mm)
+{
+	ut *ret;
+
+	if (!var) return NULL;
+
+	ret = ut_alloc(ut_type(var), mm);
+	ut_copy_data(ret, var, true);
+
+	return ret;
+}
+
+/****************************************************************/
+
+/** Finalizer of MurmurHash3 */
+static uint64_t hash_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/** FNV-1a */
+static uint64_t hash_bytes(const char *s, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while (len--) {
+		h ^= (unsigned char) *s++;
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+/** Seeds of value classes, so eg. empty string and empty list differ */
+enum { H_NULL = 1, H_BOOL, H_INTEGER, H_DOUBLE, H_STRING, H_SEQ, H_MAP, H_PTR, H_ERR, H_BYTES };
+
+/** Append element hash to sequence hash h */
+#define HASH_SEQ(h, el) ((h) = hash_mix((h) * 31 + ut_hash(el)))
+
+static uint64_t ut_hash_compute(ut *var)
+{
+	uint64_t h, sum;
+	tlist_el *tel;
+	thash_el *hel;
+	thash *th;
+	uint32_t i;
+	ut *el, tmp;
+
+	switch (ut_type(var)) {
+		case T_BOOL:
+			return hash_mix(H_BOOL + var->d.as_bool);
+		case T_INT:
+			return hash_mix(H_INTEGER ^ hash_mix((uint64_t) (long long) var->d.as_int));
+		case T_UINT:
+			return hash_mix(H_INTEGER ^ hash_mix((uint64_t) var->d.as_uint));
+		case T_INT64:
+			return hash_mix(H_INTEGER ^ hash_mix((uint64_t) var->d.as_int64));
+		case T_UINT64:
+			return hash_mix(H_INTEGER ^ hash_mix(var->d.as_uint64));
+		case T_DOUBLE:
+			/* make +0.0 and -0.0 equal, as in == */
+			if (var->d.as_double == 0.0)
+				return hash_mix(H_DOUBLE);
+			memcpy(&h, &var->d.as_double, sizeof h);
+			return hash_mix(H_DOUBLE ^ hash_mix(h));
+		case T_STRING:
+			return hash_mix(H_STRING ^ hash_bytes(xstr_string(var->d.as_xstr), xstr_length(var->d.as_xstr)));
+		case T_BYTES:
+			return hash_mix(H_BYTES ^ hash_bytes(var->d.as_bytes->s, var->d.as_bytes->len));
+		case T_LIST:
+			/* walk the list without its iterator - var may be already being iterated */
+			h = H_SEQ;
+			for (tel = var->d.as_tlist->head; tel; tel = tel->next)
+				HASH_SEQ(h, tel->val);
+			return h;
+		case T_ARRAY:
+			h = H_SEQ;
+			uta_iter_loop(var, i, el)
+				HASH_SEQ(h, el);
+			return h;
+		case T_VECTOR:
+			h = H_SEQ;
+			for (i = 0; (el = utv_get(var, i, &tmp)); i++)
+				HASH_SEQ(h, el);
+			return h;
+		case T_HASH:
+			/* order of keys is not defined - just add hashes of pairs; walk the buckets, as above */
+			sum = 0;
+			th = var->d.as_thash;
+			for (i = 0; i < th->size; i++) {
+				for (hel = th->tbl[i]; hel; hel = hel->next)
+					sum += hash_mix(hash_bytes(hel->key, strlen(hel->key)) ^ (ut_hash(hel->val) * 0x9e3779b97f4a7c15ULL));
+			}
+			return hash_mix(H_MAP ^ sum ^ thash_count(th));
+		case T_PTR:
+			return hash_mix(H_PTR ^ (uint64_t) (uintptr_t) var->d.as_ptr);
+		case T_ERR:
+			return hash_mix(H_ERR ^ var->d.as_err->code ^ hash_bytes(var->d.as_err->msg, strlen(var->d.as_err->msg)));
+		default:
+			return hash_mix(H_NULL);
+	}
+}
+
+uint64_t ut_hash(ut *var)
+{
+	struct ut_aux *aux, val;
+
+	if (!var) return 0;
+
+	aux = ut_aux(var, false);
+	if (aux && (MEMO_FLAGS(aux) & UT_MEMO_HASH))
+		return aux->hash;
+
+	val.hash = ut_hash_compute(var);
+
+	/* a container may change below it without noticing - unless shared, which makes it immutable */
+	if (aux && (ut_shared(var) || (!ut_is_container(var) && (MEMO_FLAGS(aux) & UT_MEMO))))
+		ut_memo_put(var, aux, &val, UT_MEMO_HASH);
+
+	return val.hash;
+}
+
+void uts_init(ut_seq *it, ut *var)
+{
+	it->var = var;
+	it->el = ut_is_tlist(var) ? var->d.as_tlist->head : NULL;
+	it->i = 0;
+}
+
+ut *uts_next(ut_seq *it)
+{
+	ut *ret;
+
+	if (ut_is_array(it->var))
+		return uta_get(it->var, it->i++);
+	else if (ut_is_vector(it->var))
+		return utv_get(it->var, it->i++, &it->tmp);
+
+	if (!it->el)
+		return NULL;
+
+	ret = it->el->val;
+	it->el = it->el->next;
+	return ret;
+}
+
+uint32_t uts_count(ut *var)
+{
+	switch (ut_type(var)) {
+		case T_LIST:   return tlist_count(var->d.as_tlist);
+		case T_ARRAY:  return uta_count(var);
+		case T_VECTOR: return utv_count(var);
+		default:       return 0;
+	}
+}
+
+/** True if var is an integer of any type, with its value in *v
+ * @param neg    set to true if value is negative, ie. *v holds it in two's complement */
+static bool integer_value(ut *var, uint64_t *v, bool *neg)
+{
+	switch (var->type) {
+		case T_INT:    *v = (int64_t) var->d.as_int;  *neg = var->d.as_int < 0;   return true;
+		case T_INT64:  *v = var->d.as_int64;          *neg = var->d.as_int64 < 0; return true;
+		case T_UINT:   *v = var->d.as_uint;           *neg = false;               return true;
+		case T_UINT64: *v = var->d.as_uint64;         *neg = false;               return true;
+		default:       return false;
+	}
+}
+
+bool ut_equal(ut *a, ut *b)
+{
+	struct ut_aux *aa, *ab;
+	ut_seq ia, ib;
+	uint64_t va, vb;
+	bool na, nb;
+	thash_el *hel;
+	uint32_t i;
+	ut *el, *el2;
+
+	if (a == b) return true;
+	if (!a || !b) return false;
+
+	ut_force(a);
+	ut_force(b);
+
+	/* cached hashes make it cheap to see they differ */
+	if (a->aux && b->aux && (aa = ut_aux(a, false)) && (ab = ut_aux(b, false)) &&
+	    (MEMO_FLAGS(aa) & MEMO_FLAGS(ab) & UT_MEMO_HASH) && aa->hash != ab->hash)
+		return false;
+
+	if (integer_value(a, &va, &na))
+		return integer_value(b, &vb, &nb) && va == vb && na == nb;
+
+	if (ut_is_seq(a) && ut_is_seq(b)) {
+		if (uts_count(a) != uts_count(b))
+			return false;
+
+		uts_init(&ia, a);
+		uts_init(&ib, b);
+		while ((el = uts_next(&ia)) && (el2 = uts_next(&ib))) {
+			if (!ut_equal(el, el2))
+				return false;
+		}
+
+		return true;
+	}
+
+	if (a->type != b->type)
+		return false;
+
+	switch (a->type) {
+		case T_BOOL:
+			return a->d.as_bool == b->d.as_bool;
+		case T_DOUBLE:
+			return a->d.as_double == b->d.as_double;
+		case T_STRING:
+			return xstr_length(a->d.as_xstr) == xstr_length(b->d.as_xstr) &&
+				memcmp(xstr_string(a->d.as_xstr), xstr_string(b->d.as_xstr), xstr_length(a->d.as_xstr)) == 0;
+		case T_HASH:
+			if (thash_count(a->d.as_thash) != thash_count(b->d.as_thash))
+				return false;
+
+			/* walk the buckets - a may be already being iterated */
+			for (i = 0; i < a->d.as_thash->size; i++) {
+				for (hel = a->d.as_thash->tbl[i]; hel; hel = hel->next) {
+					if (!ut_equal(hel->val, thash_get(b->d.as_thash, hel->key)))
+						return false;
+				}
+			}
+			return true;
+		case T_BYTES:
+			return a->d.as_bytes->len == b->d.as_bytes->len &&
+				memcmp(a->d.as_bytes->s, b->d.as_bytes->s, a->d.as_bytes->len) == 0;
+		case T_PTR:
+			return a->d.as_ptr == b->d.as_ptr;
+		case T_ERR:
+			return a->d.as_err->code == b->d.as_err->code && streq(a->d.as_err->msg, b->d.as_err->msg);
+		default:
+			return true;
+	}
 }
@@ -37,18 +37,68 @@ typedef struct ut {
 		/* special types */
 		T_NULL,
 		T_ERR,
+
+		/* added later - kept last, so values of the above do not change */
+		T_ARRAY,     /* ut_array: compact array of ut values */
+		T_BYTES,     /* ut_bytes: binary data */
+		T_VECTOR,    /* ut_vector: numbers of one C type, stored contiguously */
+		T_LAZY,      /* ut_lazy: value not computed yet, see ut_force() */
+		T_INT64,     /* int64_t  */
+		T_UINT64,    /* uint64_t */
 	} type;
 
+	/** If not 0, this ut is not a separate allocation but slot number (slot - 1) in a T_ARRAY */
+	uint32_t slot : 31;
+
+	/** If 1, this ut has extra data in a side table of its memory manager, see ut_memoize() */
+	uint32_t aux : 1;
+
 	union ut_as {
 		bool        as_bool;
 		int         as_int;
 		uint32_t    as_uint;
+		int64_t     as_int64;
+		uint64_t    as_uint64;
 		double      as_double;
 		xstr       *as_xstr;
 		tlist      *as_tlist;
 		thash      *as_thash;
 		void       *as_ptr;
 
+		/** Values stored by value, one after another in one memory chunk */
+		struct ut_array {
+			struct ut *v;   /** values */
+			uint32_t n;     /** number of values */
+			uint32_t a;     /** allocated slots */
+		} *as_array;
+
+		/** Binary data of given length, may contain \0 */
+		struct ut_bytes {
+			const char *s;  /** data */
+			size_t len;     /** length */
+			bool ref;       /** if true, s points at memory of someone else */
+		} *as_bytes;
+
+		/** Plain C array of numbers */
+		struct ut_vector {
+			enum ut_vtype {
+				UTV_INT64 = 1,  /** int64_t */
+				UTV_UINT32,     /** uint32_t */
+				UTV_DOUBLE,     /** double */
+			} type;         /** element type */
+			uint32_t n;     /** number of elements */
+			uint32_t a;     /** allocated elements */
+			void *v;        /** elements */
+		} *as_vector;
+
+		/** Recipe for the value, replaced by the value itself on first use */
+		struct ut_lazy {
+			struct ut *(*fn)(struct ut_lazy *lz);  /** makes the value */
+			void (*free)(struct ut_lazy *lz);      /** if not NULL, called once lz is done with */
+			void *arg;                             /** for fn */
+			const void *data;                      /** for fn */
+		} *as_lazy;
+
 		struct ut_err {
 			int  code;
 			const char *msg;  /** XXX: never null */
@@ -59,15 +109,30 @@ typedef struct ut {
 
 /***** check type wrappers *****/
 
-#define ut_is_null(ut)   (ut && ut->type == T_NULL)
-#define ut_is_ptr(ut)    (ut && ut->type == T_PTR)
-#define ut_is_bool(ut)   (ut && ut->type == T_BOOL)
-#define ut_is_int(ut)    (ut && ut->type == T_INT)
-#define ut_is_uint(ut)   (ut && ut->type == T_UINT)
-#define ut_is_double(ut) (ut && ut->type == T_DOUBLE)
-#define ut_is_string(ut) (ut && ut->type == T_STRING)
-#define ut_is_tlist(ut)  (ut && ut->type == T_LIST)
-#define ut_is_thash(ut)  (ut && ut->type == T_HASH)
+/* these force T_LAZY values first, so they are never seen as such */
+#define ut_is_null(ut)   (ut && ut_forced(ut)->type == T_NULL)
+#define ut_is_ptr(ut)    (ut && ut_forced(ut)->type == T_PTR)
+#define ut_is_bool(ut)   (ut && ut_forced(ut)->type == T_BOOL)
+#define ut_is_int(ut)    (ut && ut_forced(ut)->type == T_INT)
+#define ut_is_uint(ut)   (ut && ut_forced(ut)->type == T_UINT)
+#define ut_is_int64(ut)  (ut && ut_forced(ut)->type == T_INT64)
+#define ut_is_uint64(ut) (ut && ut_forced(ut)->type == T_UINT64)
+#define ut_is_double(ut) (ut && ut_forced(ut)->type == T_DOUBLE)
+#define ut_is_string(ut) (ut && ut_forced(ut)->type == T_STRING)
+#define ut_is_tlist(ut)  (ut && ut_forced(ut)->type == T_LIST)
+#define ut_is_thash(ut)  (ut && ut_forced(ut)->type == T_HASH)
+#define ut_is_array(ut)  (ut && ut_forced(ut)->type == T_ARRAY)
+#define ut_is_bytes(ut)  (ut && ut_forced(ut)->type == T_BYTES)
+#define ut_is_vector(ut) (ut && ut_forced(ut)->type == T_VECTOR)
+
+/** True if ut is still a T_LAZY value */
+#define ut_is_lazy(ut)   (ut && ut->type == T_LAZY)
+
+/** True for values holding a sequence: T_LIST, T_ARRAY or T_VECTOR */
+#define ut_is_seq(ut)    (ut_is_tlist(ut) || ut_is_array(ut) || ut_is_vector(ut))
+
+/** Memory to allocate things related to ut in - array slots are not mmatic chunks themselves */
+#define ut_mm(ut) ((void *) ((ut)->slot ? (ut) - ((ut)->slot - 1) : (ut)))
 
 /***** error handling *****/
 
@@ -82,19 +147,21 @@ int ut_errcode(ut *ut);
 
 /***** type conversions *****/
 
-/** Return type of variable */
-#define ut_type(ut) (ut ? ut->type : T_NULL)
+/** Return type of variable, forcing T_LAZY first */
+#define ut_type(ut) (ut ? ut_forced(ut)->type : T_NULL)
 
 /* XXX: BIG FAT WARNINGS:
  *
  * 1. returned values are read-only
  * 2. if conversion needs to be done, a completely new memory is allocated @ut->mm and the pointer
- *    wont be cached at our side - its your task, if needed
+ *    wont be cached at our side - its your task, if needed, or see ut_memoize()
  */
 
 bool        ut_bool(ut *ut);
 int         ut_int(ut *ut);
 uint32_t    ut_uint(ut *ut);
+int64_t     ut_int64(ut *ut);
+uint64_t    ut_uint64(ut *ut);
 double      ut_double(ut *ut);
 xstr       *ut_xstr(ut *ut);
 const char *ut_char(ut *ut);
@@ -102,14 +169,93 @@ tlist      *ut_tlist(ut *ut);
 thash      *ut_thash(ut *ut);
 void       *ut_ptr(ut *ut);
 
-/** Free given unitype variable */
+/** Return string value of ut as a view, without copying if it already holds a string
+ * @note invalidated by changes to ut */
+xstr_view   ut_view(ut *ut);
+
+/** Return binary data of T_BYTES ut, or ut_view() for other types
+ * @note invalidated by changes to ut */
+xstr_view   ut_bytes(ut *ut);
+
+/** Enable or disable caching of type conversions
+ *
+ * When enabled, conversions of scalar nodes made by ut_xstr(), ut_char(), ut_int(), ut_uint(),
+ * ut_int64(), ut_uint64() and ut_double() are computed once and kept aside. Caches are dropped
+ * when uth_set_*() change the node in place, or by ut_invalidate(). The cache lives in a side table
+ * of the node's memory manager, so nodes without it take no extra memory - but a cached read still
+ * costs a lookup in that table under its mutex, a few hundred nanoseconds: it pays off for parsing
+ * and formatting strings, not for values which already have the type asked for.
+ *
+ * Conversions of lists, hashes, arrays and vectors are never cached, as they depend on descendants
+ * which may change without the container knowing; array slots are not cached either.
+ *
+ * @param var    node; for lists, hashes and arrays applies to all current descendants too, and to
+ *               values added later with uth_set*() and utl_add*()
+ * @note with caching enabled, strings returned for scalar nodes belong to the node - never free them */
+void ut_memoize(ut *var, bool on);
+
+/** Drop cached conversions of var
+ * @note call after changing var->d directly */
+void ut_invalidate(ut *var);
+
+/** Free given unitype variable
+ * @note if var is shared, only drops one reference - see ut_ref()
+ * @note if var is an array slot, frees its data and leaves null in the slot */
 void ut_free(void *utarg);
 
+/***** sharing and copying *****/
+
+/* Nodes can be referenced from many places, eg. from two versions of the same tree. A shared node
+ * must be treated as immutable, with everything below it: instead of changing it in place, make a
+ * modified copy with utpath_with(), which copies only the nodes on the changed path and shares all
+ * other subtrees.
+ *
+ * A consistent snapshot of a tree is then just ut_ref(root): the writer keeps making new versions,
+ * while the readers look at the old one, which never changes under them. Reference counting is
+ * atomic, but note that mmatic is not thread-safe: readers should stick to lookups and scalar
+ * accessors (not conversions which allocate memory, nor ut_memoize()), and the last reference
+ * should be dropped in the thread which owns the memory manager. Cached numeric conversions and
+ * hashes are stored under a lock, so readers may fill them concurrently. */
+
+/** Take another reference to var, which makes it shared
+ * @note var must be a separate node, not a T_ARRAY slot
+ * @return var */
+ut *ut_ref(ut *var);
+
+/** True if var has more than one reference */
+bool ut_shared(ut *var);
+
+/** Make a shallow copy of var in mm: a new node, sharing children with var */
+ut *ut_copy(ut *var, void *mm);
+
+/** Make a deep copy of var in mm, sharing nothing with var */
+ut *ut_clone(ut *var, void *mm);
+
+/***** structural comparison *****/
+
+/** Hash contents of var, so that ut_equal() values have equal hashes
+ *
+ * Lists and arrays with the same elements hash the same, hash keys are order-independent. Hashes of
+ * shared nodes are cached, as these are immutable: hashing a snapshot or an interned tree again is
+ * a lookup, and hashing a new version made with utpath_with() only walks the copied path. Hashes of
+ * memoized scalars are cached too, but those of unshared containers are always computed in full,
+ * as their descendants may change without them knowing.
+ *
+ * @retval 0  var is NULL */
+uint64_t ut_hash(ut *var);
+
+/** True if a and b hold the same data
+ * Integers compare by value regardless of signedness, T_LIST, T_ARRAY and T_VECTOR
+ * with the same elements are equal */
+bool ut_equal(ut *a, ut *b);
+
 /***** create new unitype object - never fail ******/
 
 ut *ut_new_bool(bool val, void *mm);
 ut *ut_new_int(int val, void *mm);
 ut *ut_new_uint(uint32_t val, void *mm);
+ut *ut_new_int64(int64_t val, void *mm);
+ut *ut_new_uint64(uint64_t val, void *mm);
 ut *ut_new_double(double val, void *mm);
 ut *ut_new_char(const char *val, void *mm);
 ut *ut_new_xstr(xstr *val, void *mm);
@@ -117,8 +263,40 @@ ut *ut_new_ptr(void *val, void *mm);
 ut *ut_new_null(void *mm);
 ut *ut_new_err(int code, const char *msg, const char *data, void *mm);
 
+/** Create a string ut holding a copy of the view */
+ut *ut_new_view(xstr_view val, void *mm);
+
+/** Create a T_BYTES ut holding a copy of len bytes at data
+ *
+ * Unlike strings, bytes may contain \0. Use ut_bytes() to get them back; ut_xstr() gives a copy in
+ * an xstr, which is binary-safe as long as you look at its length. JSON output encodes them in
+ * base64. */
+ut *ut_new_bytes(const void *data, size_t len, void *mm);
+
+/** Like ut_new_bytes(), but reference data instead of copying it
+ * @note data must not change nor go away as long as the ut exists, including copies from ut_copy() */
+ut *ut_new_bytes_ref(const void *data, size_t len, void *mm);
+
+/** Create a T_LAZY ut, which on first use turns into value returned by fn
+ *
+ * Type checks, conversions and accessors all call ut_force() first, so code using the ut does not
+ * see the difference - except that unused values never cost anything.
+ * @param fn    returns the value, which may be an error; gets a copy of arg and data
+ * @param free  if not NULL, called after fn, or when the ut is freed before use - eg. to release
+ *              what arg and data point at
+ * @note not thread-safe: forcing modifies the ut, even if the caller only reads it */
+ut *ut_new_lazy(ut *(*fn)(struct ut_lazy *lz), void (*free)(struct ut_lazy *lz),
+	void *arg, const void *data, void *mm);
+
+/** Compute value of T_LAZY var in place, no-op for other types
+ * @return var */
+ut *ut_force(ut *var);
+
+/** ut_force() if needed, for use in expressions */
+#define ut_forced(ut) ((ut)->type == T_LAZY ? ut_force(ut) : (ut))
+
 /** Create new ut err object out of current errno */
-#define ut_new_errno(mm) (ut_new_err(errno, strerror(errno), mmatic_printf((mm), "%s:%u", __FILE__, __LINE__), (mm)))
+#define ut_new_errno(mm) (ut_new_err(errno, strerror(errno), mmatic_sprintf((mm), "%s:%u", __FILE__, __LINE__), (mm)))
 
 /***** hash list *****/
 
@@ -132,11 +310,14 @@ ut *ut_new_utthash(thash *val, void *mm);
 
 /* applicable for ut->type == T_HASH */
 ut *uth_get(ut *var, const char *key);
+ut *uth_get_view(ut *var, xstr_view key);
 ut *uth_set(ut *var, const char *key, ut *val);
 ut *uth_set_null(ut *ut, const char *key);
 ut *uth_set_bool(ut *ut, const char *key, bool val);
 ut *uth_set_int(ut *ut, const char *key, int val);
 ut *uth_set_uint(ut *ut, const char *key, uint32_t val);
+ut *uth_set_int64(ut *ut, const char *key, int64_t val);
+ut *uth_set_uint64(ut *ut, const char *key, uint64_t val);
 ut *uth_set_double(ut *ut, const char *key, double val);
 ut *uth_set_char(ut *ut, const char *key, const char *val);
 ut *uth_set_xstr(ut *ut, const char *key, xstr *val);
@@ -151,6 +332,8 @@ ut *uth_merge(ut *dst, ut *src);
 #define uth_bool(var, key)   ut_bool(uth_get(var, key))
 #define uth_int(var, key)    ut_int(uth_get(var, key))
 #define uth_uint(var, key)   ut_uint(uth_get(var, key))
+#define uth_int64(var, key)  ut_int64(uth_get(var, key))
+#define uth_uint64(var, key) ut_uint64(uth_get(var, key))
 #define uth_double(var, key) ut_double(uth_get(var, key))
 #define uth_xstr(var, key)   ut_xstr(uth_get(var, key))
 #define uth_char(var, key)   ut_char(uth_get(var, key))
@@ -211,6 +394,8 @@ ut *utl_add_null(ut *ut);
 ut *utl_add_bool(ut *ut, bool val);
 ut *utl_add_int(ut *ut, int val);
 ut *utl_add_uint(ut *ut, uint32_t val);
+ut *utl_add_int64(ut *ut, int64_t val);
+ut *utl_add_uint64(ut *ut, uint64_t val);
 ut *utl_add_double(ut *ut, double val);
 ut *utl_add_char(ut *ut, const char *val);
 ut *utl_add_xstr(ut *ut, xstr *val);
@@ -218,4 +403,102 @@ ut *utl_add_ptr(ut *ut, void *ptr);
 ut *utl_add_tlist(ut *ut, tlist *val);  /** @note see ut_new_tlist */
 ut *utl_add_thash(ut *ut, thash *val);  /** @note see ut_new_thash */
 
+/***** compact array *****/
+
+/* A T_ARRAY keeps its elements as struct ut values in one chunk of memory, instead of a tlist of
+ * pointers to separately allocated nodes. Scalars (null, bool, numbers, pointers) take no memory
+ * besides their 16-byte slot; strings and containers still point to their data.
+ *
+ * All ut_*() accessors work on pointers to slots, and utl_add*() append to arrays as well. Note that
+ * slot pointers are invalidated when the array grows - like pointers into a realloc()ed buffer. */
+
+/** Create an empty array
+ * @param size   number of slots to reserve upfront; may be 0 */
+ut *ut_new_array(uint32_t size, void *mm);
+
+/** Return number of values in array, or 0 if var is not an array */
+uint32_t uta_count(ut *var);
+
+/** Return pointer to slot number i
+ * @retval NULL  out of range or var is not an array */
+ut *uta_get(ut *var, uint32_t i);
+
+/** Move val into a new slot at the end of array
+ * @param val    value from ut_new_*(), which is consumed - do not use it afterwards
+ * @return       the slot */
+ut *uta_add(ut *var, ut *val);
+
+/** Replace value in slot number i with val, as in uta_add()
+ * @retval NULL  var is not an array or i is out of range - val is not consumed then */
+ut *uta_set(ut *var, uint32_t i, ut *val);
+
+/** Move val into a new slot number i, shifting following slots up, as in uta_add()
+ * @retval NULL  var is not an array or i > count - val is not consumed then */
+ut *uta_insert(ut *var, uint32_t i, ut *val);
+
+/** Free value in slot number i and shift following slots down
+ * @retval false  var is not an array or i is out of range */
+bool uta_remove(ut *var, uint32_t i);
+
+/** Iterate through array slots */
+#define uta_iter_loop(var, i, el) \
+	for ((i) = 0; (i) < uta_count(var) && ((el) = &(var)->d.as_array->v[(i)]); (i)++)
+
+/***** numeric vector *****/
+
+/* A T_VECTOR holds numbers of one type in a plain C array, eg. for vectorized loops over big
+ * numeric payloads - see JSON_VECTORS. Conversions and JSON output treat it like any other array of
+ * numbers, but its elements are not ut values themselves: use the raw pointer to get at them. */
+
+/** Create an empty vector
+ * @param size   number of elements to reserve upfront; may be 0 */
+ut *ut_new_vector(enum ut_vtype type, uint32_t size, void *mm);
+
+/** Return element type, or 0 if var is not a vector */
+enum ut_vtype utv_type(ut *var);
+
+/** Return number of elements, or 0 if var is not a vector */
+uint32_t utv_count(ut *var);
+
+/** Return pointer to elements, if var is a vector of given type
+ * @param n      if not NULL, number of elements is stored there
+ * @retval NULL  var is not a vector, or of other type
+ * @note invalidated when the vector grows */
+int64_t  *utv_int64(ut *var, uint32_t *n);
+uint32_t *utv_uint32(ut *var, uint32_t *n);
+double   *utv_double(ut *var, uint32_t *n);
+
+/** Append a number to a vector, converting it to element type
+ * @retval false  var is not a vector */
+bool utv_add_int64(ut *var, int64_t val);
+bool utv_add_double(ut *var, double val);
+
+/** Read element number i into tmp, as a T_INT, T_UINT, T_INT64 or T_DOUBLE value
+ * int64 elements which do not fit in an int are read as T_INT64.
+ * Use for generic code which wants ut values - tmp is not to be freed.
+ * @retval NULL  out of range or var is not a vector */
+ut *utv_get(ut *var, uint32_t i, ut *tmp);
+
+/***** any sequence *****/
+
+/** Iterator over elements of any sequence - see ut_is_seq()
+ * Does not touch the tlist iterator, so it is safe to nest. */
+typedef struct ut_seq {
+	ut *var;        /** the sequence */
+	tlist_el *el;   /** next T_LIST element */
+	uint32_t i;     /** next T_ARRAY or T_VECTOR index */
+	ut tmp;         /** current T_VECTOR element, see utv_get() */
+} ut_seq;
+
+/** Start iteration over var */
+void uts_init(ut_seq *it, ut *var);
+
+/** Return next element
+ * @retval NULL  no more elements
+ * @note T_VECTOR elements are returned in it->tmp, valid until next call */
+ut *uts_next(ut_seq *it);
+
+/** Return number of elements, or 0 if var is not a sequence */
+uint32_t uts_count(ut *var);
+
 #endif
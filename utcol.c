@@ -0,0 +1,668 @@
+/*
+ * utcol - columnar storage of unitype records
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include "lib.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define UTCOL_X86 1
+#include <immintrin.h>
+#endif
+
+/** Column type value asks for
+ * @retval 0   value is missing
+ * @retval -1  value can't be stored in a column */
+static int value_type(ut *v)
+{
+	switch (ut_type(v)) {
+		case T_BOOL:
+		case T_INT:
+		case T_UINT:
+		case T_INT64:  return UTCOL_INT;
+		case T_UINT64: return v->d.as_uint64 <= INT64_MAX ? UTCOL_INT : UTCOL_DOUBLE;
+		case T_DOUBLE: return UTCOL_DOUBLE;
+		case T_STRING: return UTCOL_STRING;
+		case T_NULL:   return 0;
+		default:       return -1;
+	}
+}
+
+static int64_t value_int(ut *v)
+{
+	switch (v->type) {
+		case T_BOOL:   return v->d.as_bool;
+		case T_INT:    return v->d.as_int;
+		case T_UINT:   return v->d.as_uint;
+		case T_INT64:  return v->d.as_int64;
+		case T_UINT64: return v->d.as_uint64;
+		default:       return 0;
+	}
+}
+
+/** Return column for key, adding it if needed */
+static utcol_col *add_col(utcol *t, thash *idx, const char *key, uint32_t *alloc)
+{
+	unsigned long c = thash_get_uint(idx, key);
+	utcol_col *col;
+
+	if (c)
+		return &t->c[c - 1];
+
+	if (t->n == *alloc) {
+		*alloc *= 2;
+		t->c = mmatic_resize(t->c, *alloc * sizeof *t->c);
+	}
+
+	col = &t->c[t->n++];
+	memset(col, 0, sizeof *col);
+	col->name = mmatic_strdup(t->mm, key);
+	col->n = t->rows;
+
+	thash_set(idx, col->name, (void *) (unsigned long) t->n);
+	return col;
+}
+
+/** Store string s in dictionary of col
+ * @param codes   dictionary of col: string to code + 1
+ * @return        code of s */
+static uint32_t dict_code(utcol_col *col, thash *codes, const char *s, uint32_t *alloc)
+{
+	unsigned long c = thash_get_uint(codes, s);
+
+	if (c)
+		return c - 1;
+
+	if (col->ndict == *alloc) {
+		*alloc *= 2;
+		col->dict = mmatic_resize(col->dict, *alloc * sizeof(char *));
+	}
+
+	col->dict[col->ndict] = mmatic_strdup(col->dict, s);
+	thash_set(codes, col->dict[col->ndict], (void *) (unsigned long) (col->ndict + 1));
+	return col->ndict++;
+}
+
+utcol *utcol_create(ut *rows, void *mm)
+{
+	utcol *t;
+	utcol_col *col;
+	thash *idx, **codes = NULL;
+	uint32_t alloc = 8, *dalloc = NULL, *present, r, c;
+	ut_seq it;
+	ut *row, *v;
+	char *key;
+	int type;
+
+	if (!ut_is_seq(rows))
+		return NULL;
+
+	t = mmatic_zalloc(mm, sizeof *t);
+	t->mm = mm;
+	t->rows = uts_count(rows);
+	t->c = mmatic_alloc(mm, alloc * sizeof *t->c);
+	idx = thash_create_strkey(NULL, mm);
+
+	/* pass 1: find columns and their types */
+	uts_init(&it, rows);
+	while ((row = uts_next(&it))) {
+		if (!ut_is_thash(row))
+			goto fail;
+
+		thash_iter_loop(row->d.as_thash, key, v) {
+			col = add_col(t, idx, key, &alloc);
+
+			type = value_type(v);
+			if (type < 0)
+				goto fail;
+			else if (type == 0 || type == col->type)
+				continue;
+			else if (!col->type)
+				col->type = type;
+			else if (type == UTCOL_STRING || col->type == UTCOL_STRING)
+				goto fail;
+			else
+				col->type = UTCOL_DOUBLE;
+		}
+	}
+
+	/* allocate columns; values start as missing */
+	present = mmatic_zalloc(mm, (t->n + 1) * sizeof *present);
+	codes = mmatic_zalloc(mm, (t->n + 1) * sizeof *codes);
+	dalloc = mmatic_zalloc(mm, (t->n + 1) * sizeof *dalloc);
+	for (c = 0; c < t->n; c++) {
+		col = &t->c[c];
+
+		/* all values null: call it an int column */
+		if (!col->type)
+			col->type = UTCOL_INT;
+
+		switch (col->type) {
+			case UTCOL_INT:    col->v.i = mmatic_zalloc(mm, (t->rows + 1) * sizeof(int64_t)); break;
+			case UTCOL_DOUBLE: col->v.d = mmatic_zalloc(mm, (t->rows + 1) * sizeof(double)); break;
+			case UTCOL_STRING:
+				col->v.code = mmatic_zalloc(mm, (t->rows + 1) * sizeof(uint32_t));
+				dalloc[c] = 8;
+				col->dict = mmatic_alloc(mm, dalloc[c] * sizeof(char *));
+				codes[c] = thash_create_strkey(NULL, mm);
+				break;
+		}
+
+		col->missing = mmatic_alloc(mm, t->rows + 1);
+		memset(col->missing, true, t->rows + 1);
+	}
+
+	/* pass 2: fill columns */
+	uts_init(&it, rows);
+	for (r = 0; (row = uts_next(&it)); r++) {
+		thash_iter_loop(row->d.as_thash, key, v) {
+			if (ut_is_null(v))
+				continue;
+
+			c = thash_get_uint(idx, key) - 1;
+			col = &t->c[c];
+
+			switch (col->type) {
+				case UTCOL_INT:    col->v.i[r] = value_int(v); break;
+				case UTCOL_DOUBLE: col->v.d[r] = ut_double(v); break;
+				case UTCOL_STRING: col->v.code[r] = dict_code(col, codes[c], ut_char(v), &dalloc[c]); break;
+			}
+
+			col->missing[r] = false;
+			present[c]++;
+		}
+	}
+
+	/* drop masks of complete columns, so kernels can skip them */
+	for (c = 0; c < t->n; c++) {
+		col = &t->c[c];
+		col->nmissing = t->rows - present[c];
+		if (col->nmissing == 0) {
+			mmatic_free(col->missing);
+			col->missing = NULL;
+		}
+
+		if (codes[c])
+			thash_free(codes[c]);
+	}
+
+	mmatic_free(present);
+	mmatic_free(codes);
+	mmatic_free(dalloc);
+	thash_free(idx);
+	return t;
+
+fail:
+	thash_free(idx);
+	utcol_free(t);
+	return NULL;
+}
+
+utcol_col *utcol_get(utcol *t, const char *name)
+{
+	uint32_t c;
+
+	for (c = 0; c < t->n; c++) {
+		if (streq(t->c[c].name, name))
+			return &t->c[c];
+	}
+
+	return NULL;
+}
+
+void utcol_free(utcol *t)
+{
+	utcol_col *col;
+	uint32_t c, i;
+
+	for (c = 0; c < t->n; c++) {
+		col = &t->c[c];
+
+		/* v is a union: any member frees the array */
+		if (col->v.i)     mmatic_free(col->v.i);
+		if (col->missing) mmatic_free(col->missing);
+
+		for (i = 0; i < col->ndict; i++)
+			mmatic_free(col->dict[i]);
+		if (col->dict) mmatic_free(col->dict);
+
+		mmatic_free(col->name);
+	}
+
+	mmatic_free(t->c);
+	mmatic_free(t);
+}
+
+/****************************************************************/
+
+/* Sums and min/max are done with SSE2 or AVX2, picked at first use as in scan.c. All
+ * implementations add doubles in the same order - four running sums, one per index modulo 4 -
+ * so results do not depend on the CPU. Missing values are 0 in v, which sums can ignore; min/max
+ * replace them with the first value present. */
+
+/** Kernels working on n values at v */
+struct kernels {
+	const char *name;
+	double (*sum_d)(const double *v, uint32_t n);
+	int64_t (*sum_i)(const int64_t *v, uint32_t n);
+
+	/** @param first   index of first value which is not missing */
+	void (*minmax_d)(const double *v, const bool *missing, uint32_t first, uint32_t n, double *min, double *max);
+	void (*minmax_i)(const int64_t *v, const bool *missing, uint32_t first, uint32_t n, int64_t *min, int64_t *max);
+};
+
+/*****************************************************************************/
+/******************************** Plain C ************************************/
+/*****************************************************************************/
+
+#ifndef UTCOL_X86
+static double c_sum_d(const double *v, uint32_t n)
+{
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	uint32_t i, n4 = n & ~3U;
+
+	for (i = 0; i < n4; i += 4) {
+		s0 += v[i];
+		s1 += v[i + 1];
+		s2 += v[i + 2];
+		s3 += v[i + 3];
+	}
+	for (; i < n; i++)
+		s0 += v[i];
+
+	return (s0 + s1) + (s2 + s3);
+}
+
+static int64_t c_sum_i(const int64_t *v, uint32_t n)
+{
+	int64_t sum = 0;
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		sum += v[i];
+
+	return sum;
+}
+#endif
+
+/** Min and max of values at v[first..n), skipping rows marked in missing */
+#define MINMAX(v, missing, first, n, min, max) do { \
+	uint32_t i_; \
+	min = max = v[first]; \
+	for (i_ = first + 1; i_ < n; i_++) { \
+		if (missing && missing[i_]) continue; \
+		min = v[i_] < min ? v[i_] : min; \
+		max = v[i_] > max ? v[i_] : max; \
+	} \
+} while (0)
+
+static void c_minmax_i(const int64_t *v, const bool *missing, uint32_t first, uint32_t n, int64_t *min, int64_t *max)
+{
+	MINMAX(v, missing, first, n, *min, *max);
+}
+
+#ifndef UTCOL_X86
+static void c_minmax_d(const double *v, const bool *missing, uint32_t first, uint32_t n, double *min, double *max)
+{
+	MINMAX(v, missing, first, n, *min, *max);
+}
+
+static const struct kernels c_kernels = { "c", c_sum_d, c_sum_i, c_minmax_d, c_minmax_i };
+#endif
+
+#ifdef UTCOL_X86
+/*****************************************************************************/
+/********************************** SSE2 *************************************/
+/*****************************************************************************/
+
+static double sse2_sum_d(const double *v, uint32_t n)
+{
+	__m128d s01 = _mm_setzero_pd(), s23 = _mm_setzero_pd();
+	double s[4];
+	uint32_t i, n4 = n & ~3U;
+
+	for (i = 0; i < n4; i += 4) {
+		s01 = _mm_add_pd(s01, _mm_loadu_pd(v + i));
+		s23 = _mm_add_pd(s23, _mm_loadu_pd(v + i + 2));
+	}
+
+	_mm_storeu_pd(s, s01);
+	_mm_storeu_pd(s + 2, s23);
+	for (; i < n; i++)
+		s[0] += v[i];
+
+	return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+static int64_t sse2_sum_i(const int64_t *v, uint32_t n)
+{
+	__m128i acc = _mm_setzero_si128();
+	int64_t s[2];
+	uint32_t i, n2 = n & ~1U;
+
+	for (i = 0; i < n2; i += 2)
+		acc = _mm_add_epi64(acc, _mm_loadu_si128((const __m128i *) (v + i)));
+
+	_mm_storeu_si128((__m128i *) s, acc);
+	for (; i < n; i++)
+		s[0] += v[i];
+
+	return s[0] + s[1];
+}
+
+/** All-ones 64-bit lanes where the 2 bools at m are true */
+static inline __m128i sse2_mask2(const bool *m)
+{
+	__m128i z = _mm_setzero_si128();
+	uint16_t b;
+
+	memcpy(&b, m, 2);
+	return _mm_sub_epi64(z, _mm_unpacklo_epi32(_mm_unpacklo_epi16(_mm_unpacklo_epi8(
+		_mm_cvtsi32_si128(b), z), z), z));
+}
+
+static void sse2_minmax_d(const double *v, const bool *missing, uint32_t first, uint32_t n, double *min, double *max)
+{
+	__m128d f = _mm_set1_pd(v[first]), mn = f, mx = f, x, m;
+	double a[2], b[2];
+	uint32_t i, n2 = first + ((n - first) & ~1U);
+
+	for (i = first; i < n2; i += 2) {
+		x = _mm_loadu_pd(v + i);
+		if (missing) {
+			m = _mm_castsi128_pd(sse2_mask2(missing + i));
+			x = _mm_or_pd(_mm_and_pd(m, f), _mm_andnot_pd(m, x));
+		}
+		mn = _mm_min_pd(x, mn);
+		mx = _mm_max_pd(x, mx);
+	}
+
+	_mm_storeu_pd(a, mn);
+	_mm_storeu_pd(b, mx);
+	*min = a[1] < a[0] ? a[1] : a[0];
+	*max = b[1] > b[0] ? b[1] : b[0];
+
+	if (i < n && !(missing && missing[i])) {
+		*min = v[i] < *min ? v[i] : *min;
+		*max = v[i] > *max ? v[i] : *max;
+	}
+}
+
+/* no 64-bit integer compare before SSE4.2 */
+static const struct kernels sse2_kernels = { "sse2", sse2_sum_d, sse2_sum_i, sse2_minmax_d, c_minmax_i };
+
+/*****************************************************************************/
+/********************************** AVX2 *************************************/
+/*****************************************************************************/
+
+#define AVX2 __attribute__ ((target ("avx2")))
+
+AVX2 static double avx2_sum_d(const double *v, uint32_t n)
+{
+	__m256d acc = _mm256_setzero_pd();
+	double s[4];
+	uint32_t i, n4 = n & ~3U;
+
+	for (i = 0; i < n4; i += 4)
+		acc = _mm256_add_pd(acc, _mm256_loadu_pd(v + i));
+
+	_mm256_storeu_pd(s, acc);
+	for (; i < n; i++)
+		s[0] += v[i];
+
+	return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+AVX2 static int64_t avx2_sum_i(const int64_t *v, uint32_t n)
+{
+	__m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+	int64_t s[8];
+	uint32_t i, n8 = n & ~7U;
+
+	/* integer adds can be reordered: use two sums to hide latency */
+	for (i = 0; i < n8; i += 8) {
+		a0 = _mm256_add_epi64(a0, _mm256_loadu_si256((const __m256i *) (v + i)));
+		a1 = _mm256_add_epi64(a1, _mm256_loadu_si256((const __m256i *) (v + i + 4)));
+	}
+
+	_mm256_storeu_si256((__m256i *) s, _mm256_add_epi64(a0, a1));
+	for (; i < n; i++)
+		s[0] += v[i];
+
+	return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+/** All-ones 64-bit lanes where the 4 bools at m are true */
+AVX2 static inline __m256i avx2_mask4(const bool *m)
+{
+	uint32_t b;
+
+	memcpy(&b, m, 4);
+	return _mm256_sub_epi64(_mm256_setzero_si256(), _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(b)));
+}
+
+AVX2 static void avx2_minmax_d(const double *v, const bool *missing, uint32_t first, uint32_t n, double *min, double *max)
+{
+	__m256d f = _mm256_set1_pd(v[first]), mn = f, mx = f, x;
+	double a[4], b[4];
+	uint32_t i, k, n4 = first + ((n - first) & ~3U);
+
+	for (i = first; i < n4; i += 4) {
+		x = _mm256_loadu_pd(v + i);
+		if (missing)
+			x = _mm256_blendv_pd(x, f, _mm256_castsi256_pd(avx2_mask4(missing + i)));
+		mn = _mm256_min_pd(x, mn);
+		mx = _mm256_max_pd(x, mx);
+	}
+
+	_mm256_storeu_pd(a, mn);
+	_mm256_storeu_pd(b, mx);
+	*min = a[0];
+	*max = b[0];
+	for (k = 1; k < 4; k++) {
+		*min = a[k] < *min ? a[k] : *min;
+		*max = b[k] > *max ? b[k] : *max;
+	}
+
+	for (; i < n; i++) {
+		if (missing && missing[i]) continue;
+		*min = v[i] < *min ? v[i] : *min;
+		*max = v[i] > *max ? v[i] : *max;
+	}
+}
+
+AVX2 static void avx2_minmax_i(const int64_t *v, const bool *missing, uint32_t first, uint32_t n, int64_t *min, int64_t *max)
+{
+	__m256i f = _mm256_set1_epi64x(v[first]), mn = f, mx = f, x;
+	int64_t a[4], b[4];
+	uint32_t i, k, n4 = first + ((n - first) & ~3U);
+
+	for (i = first; i < n4; i += 4) {
+		x = _mm256_loadu_si256((const __m256i *) (v + i));
+		if (missing)
+			x = _mm256_blendv_epi8(x, f, avx2_mask4(missing + i));
+		mn = _mm256_blendv_epi8(mn, x, _mm256_cmpgt_epi64(mn, x));
+		mx = _mm256_blendv_epi8(mx, x, _mm256_cmpgt_epi64(x, mx));
+	}
+
+	_mm256_storeu_si256((__m256i *) a, mn);
+	_mm256_storeu_si256((__m256i *) b, mx);
+	*min = a[0];
+	*max = b[0];
+	for (k = 1; k < 4; k++) {
+		*min = a[k] < *min ? a[k] : *min;
+		*max = b[k] > *max ? b[k] : *max;
+	}
+
+	for (; i < n; i++) {
+		if (missing && missing[i]) continue;
+		*min = v[i] < *min ? v[i] : *min;
+		*max = v[i] > *max ? v[i] : *max;
+	}
+}
+
+static const struct kernels avx2_kernels = { "avx2", avx2_sum_d, avx2_sum_i, avx2_minmax_d, avx2_minmax_i };
+#endif /* UTCOL_X86 */
+
+/*****************************************************************************/
+/******************************** Dispatch ***********************************/
+/*****************************************************************************/
+
+static const struct kernels *kern = NULL;
+
+/** Return kernels for this CPU
+ * @note racing threads would just store the same pointer */
+static const struct kernels *kernels(void)
+{
+	if (kern)
+		return kern;
+
+#ifdef UTCOL_X86
+	__builtin_cpu_init();
+	kern = __builtin_cpu_supports("avx2") ? &avx2_kernels : &sse2_kernels;
+#else
+	kern = &c_kernels;
+#endif
+
+	dbg(8, "using %s\n", kern->name);
+	return kern;
+}
+
+int64_t utcol_sum_int(const utcol_col *col)
+{
+	if (col->type != UTCOL_INT)
+		return 0;
+
+	/* missing values are 0 */
+	return kernels()->sum_i(col->v.i, col->n);
+}
+
+double utcol_sum(const utcol_col *col)
+{
+	switch (col->type) {
+		case UTCOL_INT:
+			return utcol_sum_int(col);
+		case UTCOL_DOUBLE:
+			return kernels()->sum_d(col->v.d, col->n);
+		default:
+			return 0;
+	}
+}
+
+bool utcol_minmax(const utcol_col *col, double *min, double *max)
+{
+	int64_t imin, imax;
+	double dmin, dmax;
+	uint32_t first = 0;
+
+	if (utcol_count(col) == 0)
+		return false;
+
+	if (col->missing)
+		while (col->missing[first]) first++;
+
+	switch (col->type) {
+		case UTCOL_INT:
+			kernels()->minmax_i(col->v.i, col->missing, first, col->n, &imin, &imax);
+			dmin = imin;
+			dmax = imax;
+			break;
+		case UTCOL_DOUBLE:
+			kernels()->minmax_d(col->v.d, col->missing, first, col->n, &dmin, &dmax);
+			break;
+		default:
+			return false;
+	}
+
+	if (min) *min = dmin;
+	if (max) *max = dmax;
+	return true;
+}
+
+void utcol_group_sum(const utcol_col *key, const utcol_col *val, double *sum, uint32_t *count)
+{
+	const uint32_t *g = key->v.code;
+	uint32_t i, n = MIN(key->n, val->n);
+
+	if (sum) memset(sum, 0, key->ndict * sizeof *sum);
+	if (count) memset(count, 0, key->ndict * sizeof *count);
+
+	for (i = 0; i < n; i++) {
+		if ((key->missing && key->missing[i]) || (val->missing && val->missing[i]))
+			continue;
+
+		if (sum) sum[g[i]] += (val->type == UTCOL_INT) ? (double) val->v.i[i] : val->v.d[i];
+		if (count) count[g[i]]++;
+	}
+}
+
+ut *utcol_group(const utcol_col *key, const utcol_col *val, void *mm)
+{
+	double *sum, *min, *max, x;
+	uint32_t *count, i, n, g;
+	ut *ret, *grp;
+
+	if (key->type != UTCOL_STRING || (val->type != UTCOL_INT && val->type != UTCOL_DOUBLE))
+		return NULL;
+
+	sum = mmatic_alloc(mm, (key->ndict + 1) * sizeof(double));
+	min = mmatic_alloc(mm, (key->ndict + 1) * sizeof(double));
+	max = mmatic_alloc(mm, (key->ndict + 1) * sizeof(double));
+	count = mmatic_alloc(mm, (key->ndict + 1) * sizeof(uint32_t));
+
+	utcol_group_sum(key, val, sum, count);
+
+	/* min and max in a second pass, with first value of each group known from count */
+	for (g = 0; g < key->ndict; g++) {
+		min[g] = INFINITY;
+		max[g] = -INFINITY;
+	}
+
+	n = MIN(key->n, val->n);
+	for (i = 0; i < n; i++) {
+		if ((key->missing && key->missing[i]) || (val->missing && val->missing[i]))
+			continue;
+
+		g = key->v.code[i];
+		x = (val->type == UTCOL_INT) ? (double) val->v.i[i] : val->v.d[i];
+		if (x < min[g]) min[g] = x;
+		if (x > max[g]) max[g] = x;
+	}
+
+	ret = ut_new_utthash(NULL, mm);
+	for (g = 0; g < key->ndict; g++) {
+		grp = uth_set(ret, key->dict[g], ut_new_utthash(NULL, mm));
+		uth_set_uint(grp, "count", count[g]);
+		uth_set_double(grp, "sum", sum[g]);
+
+		if (count[g] > 0) {
+			uth_set_double(grp, "min", min[g]);
+			uth_set_double(grp, "max", max[g]);
+		}
+	}
+
+	mmatic_free(sum);
+	mmatic_free(min);
+	mmatic_free(max);
+	mmatic_free(count);
+	return ret;
+}
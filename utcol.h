@@ -0,0 +1,129 @@
+/*
+ * utcol - columnar storage of unitype records
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _UTCOL_H_
+#define _UTCOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "unitype.h"
+
+/** One column: values of one hash key across all rows */
+typedef struct utcol_col {
+	/** Hash key */
+	const char *name;
+
+	/** Type of values */
+	enum utcol_type {
+		UTCOL_INT = 1,  /** T_INT, T_UINT and T_BOOL values, in v.i */
+		UTCOL_DOUBLE,   /** T_DOUBLE values, possibly mixed with integers, in v.d */
+		UTCOL_STRING,   /** T_STRING values, as codes into dict, in v.code */
+	} type;
+
+	/** Value for each row; 0 where the row does not have it */
+	union {
+		int64_t  *i;
+		double   *d;
+		uint32_t *code;
+	} v;
+
+	/** Number of rows */
+	uint32_t n;
+
+	/** If not NULL, missing[i] is true where row i does not have the value, or has null */
+	bool *missing;
+
+	/** Number of rows with missing value */
+	uint32_t nmissing;
+
+	/** UTCOL_STRING: distinct values, in order of appearance */
+	char **dict;
+
+	/** UTCOL_STRING: number of distinct values */
+	uint32_t ndict;
+} utcol_col;
+
+/** A table of rows stored by column */
+typedef struct utcol {
+	void *mm;         /** memory for everything below */
+	uint32_t rows;    /** number of rows */
+	uint32_t n;       /** number of columns */
+	utcol_col *c;     /** columns, in order of first appearance */
+} utcol;
+
+/** Convert a sequence of flat hashes into columns
+ *
+ * Each hash key becomes a column. Rows may lack some keys, or have them null - see
+ * utcol_col.missing. Strings are dictionary encoded, so that repeated values are stored once and
+ * compared as integers.
+ *
+ * @param rows    T_LIST or T_ARRAY of T_HASH values
+ * @retval NULL   rows is not such a sequence, a value is not a scalar, or a key has both
+ *                string and number values
+ */
+utcol *utcol_create(ut *rows, void *mm);
+
+/** Return column of given name
+ * @retval NULL  no such column */
+utcol_col *utcol_get(utcol *t, const char *name);
+
+/** Free the table */
+void utcol_free(utcol *t);
+
+/***** aggregations *****/
+
+/* Sums and min/max use SSE2 or AVX2 - whichever the CPU supports, as detected on first call - and
+ * give the same results with either. Grouping is plain C: adding into per-group sums is a scatter,
+ * which does not vectorize. */
+
+/** Number of rows which have the value */
+#define utcol_count(col) ((col)->n - (col)->nmissing)
+
+/** Sum of UTCOL_INT or UTCOL_DOUBLE column, skipping missing values */
+double utcol_sum(const utcol_col *col);
+
+/** Exact sum of UTCOL_INT column - may overflow */
+int64_t utcol_sum_int(const utcol_col *col);
+
+/** Find minimum and maximum of UTCOL_INT or UTCOL_DOUBLE column, skipping missing values
+ * @param min    may be NULL
+ * @param max    may be NULL
+ * @retval false  no values, or not a numeric column */
+bool utcol_minmax(const utcol_col *col, double *min, double *max);
+
+/** Sum val in groups given by UTCOL_STRING column key
+ *
+ * Group number i is for string key->dict[i]. Rows missing key or val are skipped.
+ *
+ * @param sum     key->ndict sums, or NULL
+ * @param count   key->ndict counts, or NULL
+ */
+void utcol_group_sum(const utcol_col *key, const utcol_col *val, double *sum, uint32_t *count);
+
+/** Group val by key and aggregate, as in SQL GROUP BY
+ *
+ * @return  T_HASH of key string to T_HASH with "count", "sum", "min" and "max" of val
+ * @retval NULL  key is not a UTCOL_STRING column, or val is not numeric
+ */
+ut *utcol_group(const utcol_col *key, const utcol_col *val, void *mm);
+
+#endif /* _UTCOL_H_ */
@@ -0,0 +1,125 @@
+/*
+ * utintern - hash-consing of unitype trees
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "lib.h"
+
+static unsigned int intern_hash(const void *key)
+{
+	return (unsigned int) ut_hash((ut *) key);
+}
+
+static int intern_cmp(const void *key1, const void *key2)
+{
+	return !ut_equal((ut *) key1, (ut *) key2);
+}
+
+utintern *utintern_create(void *mm)
+{
+	utintern *t = mmatic_alloc(mm, sizeof *t);
+
+	t->tbl = thash_create(intern_hash, intern_cmp, ut_free, false, mm);
+	return t;
+}
+
+static ut *canon(utintern *t, ut *var);
+
+/** Replace children of var with canonical nodes */
+static void canon_children(utintern *t, ut *var)
+{
+	tlist_el *el;
+	char *key;
+	uint32_t i;
+	ut *child, *c;
+
+	switch (ut_type(var)) {
+		case T_LIST:
+			for (el = var->d.as_tlist->head; el; el = el->next) {
+				child = el->val;
+				c = canon(t, child);
+				if (c != child) {
+					ut_free(child);
+					el->val = c;
+				}
+			}
+			break;
+		case T_HASH:
+			thash_iter_loop(var->d.as_thash, key, child) {
+				c = canon(t, child);
+				if (c != child)
+					thash_set(var->d.as_thash, key, c);  /* frees child */
+			}
+			break;
+		case T_ARRAY:
+			/* slots can't be shared, but their children can */
+			uta_iter_loop(var, i, child)
+				canon_children(t, child);
+			break;
+		default:
+			break;
+	}
+}
+
+/** Find or make canonical node equal to var
+ * @return var itself, or a new reference to an equal node - then the caller drops var */
+static ut *canon(utintern *t, ut *var)
+{
+	ut *found;
+
+	/* shared nodes can't be changed - only intern their children if var is new */
+	if (!ut_shared(var))
+		canon_children(t, var);
+
+	found = thash_get(t->tbl, var);
+	if (found)
+		return (found == var) ? var : ut_ref(found);
+
+	thash_set(t->tbl, var, ut_ref(var));
+	return var;
+}
+
+ut *utintern_get(utintern *t, ut *var)
+{
+	ut *c;
+
+	if (!var) return NULL;
+
+	c = canon(t, var);
+	if (c != var)
+		ut_free(var);
+
+	return c;
+}
+
+unsigned int utintern_count(utintern *t)
+{
+	return thash_count(t->tbl);
+}
+
+void utintern_flush(utintern *t)
+{
+	thash_flush(t->tbl);
+}
+
+void utintern_free(utintern *t)
+{
+	thash_free(t->tbl);
+	mmatic_free(t);
+}
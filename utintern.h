@@ -0,0 +1,60 @@
+/*
+ * utintern - hash-consing of unitype trees
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _UTINTERN_H_
+#define _UTINTERN_H_
+
+#include "unitype.h"
+
+/** A table of canonical unitype nodes
+ *
+ * Interning a tree replaces its subtrees with equal nodes already in the table, so that identical
+ * data is kept in memory only once and shared by reference - see ut_ref(). Canonical nodes are
+ * shared and thus immutable: to change an interned tree, use utpath_with(). */
+typedef struct utintern {
+	/** Canonical nodes, keyed by themselves with ut_hash() and ut_equal() */
+	thash *tbl;
+} utintern;
+
+/** Create an empty table */
+utintern *utintern_create(void *mm);
+
+/** Return canonical version of var
+ *
+ * Children of var are interned first, then var itself is looked up. If an equal node is already
+ * in the table, var is freed and a new reference to that node is returned. Otherwise var becomes
+ * the canonical node.
+ *
+ * @param var    a separate node, not a T_ARRAY slot - it is consumed
+ * @return       canonical node, to be released with ut_free()
+ */
+ut *utintern_get(utintern *t, ut *var);
+
+/** Number of canonical nodes */
+unsigned int utintern_count(utintern *t);
+
+/** Drop all canonical nodes - nodes still referenced elsewhere are not freed */
+void utintern_flush(utintern *t);
+
+/** Free the table, as in utintern_flush() */
+void utintern_free(utintern *t);
+
+#endif /* _UTINTERN_H_ */
@@ -0,0 +1,460 @@
+/*
+ * utpatch - structural diff and patch of unitype trees
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "lib.h"
+
+/****************************************************************/
+
+/** Append escaped path component to path (RFC 6901)
+ * @return previous length of path, for path_pop() */
+static size_t path_push(xstr *path, const char *key)
+{
+	size_t len = xstr_length(path);
+
+	xstr_append_char(path, '/');
+	for (; *key; key++) {
+		switch (*key) {
+			case '~': xstr_append_size(path, "~0", 2); break;
+			case '/': xstr_append_size(path, "~1", 2); break;
+			default:  xstr_append_char(path, *key);    break;
+		}
+	}
+
+	return len;
+}
+
+static size_t path_push_index(xstr *path, uint32_t i)
+{
+	size_t len = xstr_length(path);
+
+	xstr_append_char(path, '/');
+	xstr_append_uint(path, i);
+
+	return len;
+}
+
+static void path_pop(xstr *path, size_t len)
+{
+	path->len = len;
+	path->s[len] = '\0';
+}
+
+/** Append operation to patch */
+static void add_op(ut *patch, const char *op, xstr *path, ut *value)
+{
+	ut *o = ut_new_utthash(NULL, ut_mm(patch));
+
+	uth_set_char(o, "op", op);
+	uth_set_char(o, "path", xstr_string(path));
+	if (value)
+		uth_set(o, "value", ut_clone(value, ut_mm(patch)));
+
+	utl_add(patch, o);
+}
+
+static void diff(ut *patch, xstr *path, ut *a, ut *b)
+{
+	ut_seq ia, ib;
+	uint32_t i, na, nb;
+	size_t len;
+	char *key;
+	ut *el, *el2;
+
+	/* also keeps thash iterators of shared nodes apart */
+	if (a == b)
+		return;
+
+	if (ut_is_thash(a) && ut_is_thash(b)) {
+		thash_iter_loop(a->d.as_thash, key, el) {
+			len = path_push(path, key);
+			el2 = uth_get(b, key);
+			if (el2)
+				diff(patch, path, el, el2);
+			else
+				add_op(patch, "remove", path, NULL);
+			path_pop(path, len);
+		}
+
+		thash_iter_loop(b->d.as_thash, key, el2) {
+			if (uth_get(a, key)) continue;
+
+			len = path_push(path, key);
+			add_op(patch, "add", path, el2);
+			path_pop(path, len);
+		}
+	} else if (ut_is_seq(a) && ut_is_seq(b) && !ut_is_vector(a)) {
+		/* T_VECTOR is left to "replace" below: its elements aren't nodes, so no path reaches them */
+		na = uts_count(a);
+		nb = uts_count(b);
+
+		uts_init(&ia, a);
+		uts_init(&ib, b);
+		for (i = 0; i < nb; i++) {
+			el2 = uts_next(&ib);
+			el = (i < na) ? uts_next(&ia) : NULL;
+
+			len = path_push_index(path, i);
+			if (el)
+				diff(patch, path, el, el2);
+			else
+				add_op(patch, "add", path, el2);
+			path_pop(path, len);
+		}
+
+		/* remove from the end, so indices stay valid */
+		for (i = na; i > nb; i--) {
+			len = path_push_index(path, i - 1);
+			add_op(patch, "remove", path, NULL);
+			path_pop(path, len);
+		}
+	} else if (!ut_equal(a, b)) {
+		add_op(patch, "replace", path, b);
+	}
+}
+
+ut *utpatch_diff(ut *from, ut *to, void *mm)
+{
+	ut *patch = ut_new_uttlist(NULL, mm);
+	xstr *path = xstr_create("", mm);
+
+	diff(patch, path, from, to);
+
+	xstr_free(path);
+	mmatic_free(path);
+	return patch;
+}
+
+/****************************************************************/
+
+/** What put() does with existing values */
+enum put_mode {
+	PUT_ADD,      /** insert into sequences, set in hashes */
+	PUT_REPLACE,  /** target must exist */
+};
+
+static ut *perr(ut *doc, int code, const char *msg, const char *path)
+{
+	return ut_new_err(code, msg, path, ut_mm(doc));
+}
+
+/** Return parent of path target
+ * @retval NULL  parent does not exist */
+static ut *parent_of(const utpath *p, ut *doc)
+{
+	utpath up = { p->p, p->n - 1 };
+	return utpath_get(&up, doc);
+}
+
+/** Return list element number idx
+ * @retval NULL  out of range */
+static tlist_el *list_el(tlist *list, int64_t idx)
+{
+	tlist_el *el;
+
+	if (idx < 0 || idx >= list->size)
+		return NULL;
+
+	for (el = list->head; idx > 0; idx--)
+		el = el->next;
+
+	return el;
+}
+
+/** True if path component refers to the end of a sequence */
+#define IS_END(part, size) ((part)->idx == (size) || ((part)->len == 1 && (part)->key[0] == '-'))
+
+/** Put val at path, consuming it */
+static ut *put(ut **doc, const utpath *p, const char *pstr, ut *val, enum put_mode mode)
+{
+	const struct utpath_part *last;
+	tlist_el *el;
+	tlist *list;
+	ut *parent;
+
+	if (p->n == 0) {
+		ut_free(*doc);
+		*doc = val;
+		return NULL;
+	}
+
+	parent = parent_of(p, *doc);
+	last = &p->p[p->n - 1];
+
+	switch (ut_type(parent)) {
+		case T_HASH:
+			if (mode == PUT_REPLACE && !uth_get(parent, last->key))
+				break;
+
+			uth_set(parent, last->key, val);
+			return NULL;
+
+		case T_LIST:
+			list = parent->d.as_tlist;
+
+			if (mode == PUT_ADD && IS_END(last, list->size)) {
+				tlist_push(list, val);
+			} else if (!(el = list_el(list, last->idx))) {
+				break;
+			} else if (mode == PUT_ADD) {
+				/* tlist_insertbefore() inserts before the iterator */
+				list->current = el;
+				tlist_insertbefore(list, val);
+			} else {
+				if (list->free_func)
+					list->free_func(el->val);
+				el->val = val;
+			}
+
+			ut_invalidate(parent);
+			return NULL;
+
+		case T_ARRAY:
+			if (mode == PUT_ADD && IS_END(last, uta_count(parent)))
+				uta_add(parent, val);
+			else if (last->idx < 0 || last->idx > UINT32_MAX)
+				break;
+			else if (!(mode == PUT_ADD ? uta_insert(parent, last->idx, val) : uta_set(parent, last->idx, val)))
+				break;
+
+			return NULL;
+
+		default:
+			break;
+	}
+
+	ut_free(val);
+	return perr(*doc, 3, "patch: path not found", pstr);
+}
+
+/** Remove value at path */
+static ut *del(ut **doc, const utpath *p, const char *pstr)
+{
+	const struct utpath_part *last;
+	tlist_el *el;
+	tlist *list;
+	ut *parent, *val;
+
+	if (p->n == 0)
+		return perr(*doc, 4, "patch: can't remove the root", pstr);
+
+	parent = parent_of(p, *doc);
+	last = &p->p[p->n - 1];
+
+	switch (ut_type(parent)) {
+		case T_HASH:
+			if (!uth_get(parent, last->key))
+				break;
+
+			thash_set(parent->d.as_thash, last->key, NULL);
+			ut_invalidate(parent);
+			return NULL;
+
+		case T_LIST:
+			list = parent->d.as_tlist;
+			if (!(el = list_el(list, last->idx)))
+				break;
+
+			/* tlist_remove() removes the element before the iterator: the head, if iterator is
+			 * at the head, or the tail if iterator is at the end */
+			list->current = (el == list->head) ? el : el->next;
+			val = tlist_remove(list);
+			if (list->free_func)
+				list->free_func(val);
+
+			ut_invalidate(parent);
+			return NULL;
+
+		case T_ARRAY:
+			if (last->idx < 0 || last->idx > UINT32_MAX || !uta_remove(parent, last->idx))
+				break;
+
+			return NULL;
+
+		default:
+			break;
+	}
+
+	return perr(*doc, 3, "patch: path not found", pstr);
+}
+
+/** Compile path given in op under key
+ * @retval NULL  missing or invalid */
+static utpath *op_path(ut *op, const char *key, const char **pstr, void *mm)
+{
+	*pstr = ut_is_string(uth_get(op, key)) ? uth_char(op, key) : NULL;
+	return *pstr ? utpath_compile(*pstr, mm) : NULL;
+}
+
+/** Apply one operation */
+static ut *apply_op(ut **doc, ut *op, void *mm)
+{
+	const char *name, *pstr, *fstr;
+	utpath *p, *from = NULL;
+	ut *rv = NULL, *val;
+
+	name = ut_is_string(uth_get(op, "op")) ? uth_char(op, "op") : "";
+
+	p = op_path(op, "path", &pstr, mm);
+	if (!p)
+		return perr(*doc, 1, "patch: invalid path", pstr);
+
+	if (streq(name, "add") || streq(name, "replace") || streq(name, "test")) {
+		val = uth_get(op, "value");
+		if (!val) {
+			rv = perr(*doc, 2, "patch: value missing", pstr);
+		} else if (streq(name, "test")) {
+			if (!ut_equal(utpath_get(p, *doc), val))
+				rv = perr(*doc, 5, "patch: test failed", pstr);
+		} else if (streq(name, "replace") && !utpath_get(p, *doc)) {
+			rv = perr(*doc, 3, "patch: path not found", pstr);
+		} else {
+			rv = put(doc, p, pstr, ut_clone(val, ut_mm(*doc)),
+				streq(name, "add") ? PUT_ADD : PUT_REPLACE);
+		}
+	} else if (streq(name, "remove")) {
+		rv = del(doc, p, pstr);
+	} else if (streq(name, "move") || streq(name, "copy")) {
+		from = op_path(op, "from", &fstr, mm);
+		val = from ? utpath_get(from, *doc) : NULL;
+
+		if (!val) {
+			rv = perr(*doc, 3, "patch: path not found", fstr);
+		} else {
+			val = ut_clone(val, ut_mm(*doc));
+
+			/* moving into own child would leave the value nowhere */
+			if (streq(name, "move") && strncmp(pstr, fstr, strlen(fstr)) == 0 && pstr[strlen(fstr)] == '/')
+				rv = perr(*doc, 6, "patch: can't move into own child", pstr);
+			else if (streq(name, "move") && from->n > 0)
+				rv = del(doc, from, fstr);
+
+			if (rv)
+				ut_free(val);
+			else
+				rv = put(doc, p, pstr, val, PUT_ADD);
+		}
+	} else {
+		rv = perr(*doc, 7, "patch: unknown operation", name);
+	}
+
+	utpath_free(p);
+	if (from) utpath_free(from);
+	return rv;
+}
+
+ut *utpatch_apply(ut **doc, ut *patch)
+{
+	mmatic *mm;
+	ut_seq it;
+	ut *op, *rv = NULL;
+
+	if (!ut_is_seq(patch))
+		return perr(*doc, 8, "patch: not a list of operations", NULL);
+
+	mm = mmatic_create();
+	uts_init(&it, patch);
+	while (!rv && (op = uts_next(&it)))
+		rv = apply_op(doc, op, mm);
+
+	mmatic_destroy(mm);
+	return rv;
+}
+
+/****************************************************************/
+
+static ut *merge_diff(ut *a, ut *b, void *mm)
+{
+	ut *patch, *el, *el2;
+	char *key;
+
+	if (a == b || !ut_is_thash(a) || !ut_is_thash(b))
+		return ut_equal(a, b) ? ut_new_utthash(NULL, mm) : ut_clone(b, mm);
+
+	patch = ut_new_utthash(NULL, mm);
+
+	thash_iter_loop(a->d.as_thash, key, el) {
+		if (!uth_get(b, key))
+			uth_set(patch, key, ut_new_null(mm));
+	}
+
+	thash_iter_loop(b->d.as_thash, key, el2) {
+		el = uth_get(a, key);
+
+		if (!el)
+			uth_set(patch, key, ut_clone(el2, mm));
+		else if (ut_is_thash(el) && ut_is_thash(el2)) {
+			/* empty sub-patch means no changes */
+			el = merge_diff(el, el2, mm);
+			if (thash_count(el->d.as_thash) > 0)
+				uth_set(patch, key, el);
+			else
+				ut_free(el);
+		} else if (!ut_equal(el, el2))
+			uth_set(patch, key, ut_clone(el2, mm));
+	}
+
+	return patch;
+}
+
+ut *utpatch_merge_diff(ut *from, ut *to, void *mm)
+{
+	return merge_diff(from, to, mm);
+}
+
+/** Merge patch into target
+ * @return target, or a new value to replace it with - target is not freed then */
+static ut *merge(ut *target, ut *patch, void *mm)
+{
+	ut *el, *child;
+	char *key;
+
+	if (!ut_is_thash(patch))
+		return ut_clone(patch, mm);
+
+	if (!ut_is_thash(target))
+		target = ut_new_utthash(NULL, mm);
+
+	thash_iter_loop(patch->d.as_thash, key, el) {
+		if (ut_is_null(el)) {
+			if (uth_get(target, key))
+				thash_set(target->d.as_thash, key, NULL);
+			continue;
+		}
+
+		child = uth_get(target, key);
+		el = merge(child, el, mm);
+		if (el != child)
+			uth_set(target, key, el);  /* frees child */
+	}
+
+	ut_invalidate(target);
+	return target;
+}
+
+void utpatch_merge(ut **doc, ut *patch)
+{
+	ut *ret = merge(*doc, patch, ut_mm(*doc));
+
+	if (ret != *doc) {
+		ut_free(*doc);
+		*doc = ret;
+	}
+}
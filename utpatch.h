@@ -0,0 +1,69 @@
+/*
+ * utpatch - structural diff and patch of unitype trees
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _UTPATCH_H_
+#define _UTPATCH_H_
+
+#include "unitype.h"
+
+/***** JSON Patch (RFC 6902) *****/
+
+/** Compare two trees and return a JSON Patch which turns from into to
+ *
+ * The patch is a T_LIST of operations, ready for json_print(). Values in it are copies, so it does
+ * not depend on from nor to. Sequences are compared element by element, with extra elements added
+ * or removed at the end - no attempt is made to find moved elements. A T_VECTOR in from is replaced
+ * as a whole, as paths can't point into it.
+ *
+ * @param mm    memory for the patch
+ * @return      patch; empty list if trees are equal
+ */
+ut *utpatch_diff(ut *from, ut *to, void *mm);
+
+/** Apply JSON Patch to a tree, in place
+ *
+ * Supports all operations: add, remove, replace, move, copy and test. Values are copied from
+ * the patch. Paths may go through T_HASH, T_LIST and T_ARRAY values.
+ *
+ * @param doc     tree to change; may be replaced as a whole, eg. by "replace" of path ""
+ * @retval NULL   success
+ * @return        error object, with failed path in data; operations before the failed one stay
+ *                applied - apply to ut_clone() of doc if you need it all-or-nothing
+ */
+ut *utpatch_apply(ut **doc, ut *patch);
+
+/***** JSON Merge Patch (RFC 7396) *****/
+
+/** Compare two trees and return a JSON Merge Patch which turns from into to
+ *
+ * Changed hash keys are given with new values, removed keys as null. Other changes replace the
+ * value as a whole. Note that a merge patch can't set a hash key to null.
+ *
+ * @param mm    memory for the patch
+ * @return      patch; empty hash if trees are equal
+ */
+ut *utpatch_merge_diff(ut *from, ut *to, void *mm);
+
+/** Apply JSON Merge Patch to a tree, in place
+ * @param doc     tree to change; replaced as a whole if patch is not a hash */
+void utpatch_merge(ut **doc, ut *patch);
+
+#endif /* _UTPATCH_H_ */
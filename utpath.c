@@ -0,0 +1,259 @@
+/*
+ * utpath - precompiled paths into unitype trees
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdarg.h>
+
+#include "lib.h"
+
+/** Fill in part from already unescaped key */
+static void part_init(struct utpath_part *part, char *key, size_t len)
+{
+	size_t i;
+
+	part->key = key;
+	part->len = len;
+	part->hash = thash_str_hash_len(key, len);
+
+	/* RFC 6901 array index: "0" or digits without leading zero */
+	part->idx = -1;
+	if (len == 0 || len > 18 || (key[0] == '0' && len > 1))
+		return;
+
+	for (i = 0; i < len; i++)
+		if (key[i] < '0' || key[i] > '9') return;
+
+	part->idx = 0;
+	for (i = 0; i < len; i++)
+		part->idx = part->idx * 10 + (key[i] - '0');
+}
+
+utpath *utpath_compile(const char *ptr, void *mm)
+{
+	utpath *path;
+	const char *s;
+	char *key;
+	size_t len;
+	uint32_t n = 0;
+
+	if (!ptr || (*ptr && *ptr != '/'))
+		return NULL;
+
+	for (s = ptr; *s; s++) {
+		if (*s == '/')
+			n++;
+		else if (*s == '~' && s[1] != '0' && s[1] != '1')
+			return NULL;
+	}
+
+	path = mmatic_alloc(mm, sizeof *path);
+	path->n = n;
+	path->p = n ? mmatic_alloc(mm, n * sizeof *path->p) : NULL;
+
+	for (n = 0; *ptr; n++) {
+		ptr++; /* skip '/' */
+		len = strcspn(ptr, "/");
+		key = mmatic_alloc(mm, len + 1);
+
+		/* unescape: ~1 -> '/', ~0 -> '~' */
+		for (s = ptr, len = 0; *s && *s != '/'; s++) {
+			if (*s == '~') {
+				key[len++] = (*++s == '1') ? '/' : '~';
+			} else {
+				key[len++] = *s;
+			}
+		}
+		key[len] = '\0';
+
+		part_init(&path->p[n], key, len);
+		ptr = s;
+	}
+
+	return path;
+}
+
+utpath *utpath_keys_(void *mm, const char *key, ...)
+{
+	utpath *path;
+	va_list keys;
+	const char *k;
+	uint32_t n = 0;
+
+	va_start(keys, key);
+	for (k = key; k && *k; k = va_arg(keys, const char *))
+		n++;
+	va_end(keys);
+
+	path = mmatic_alloc(mm, sizeof *path);
+	path->n = n;
+	path->p = n ? mmatic_alloc(mm, n * sizeof *path->p) : NULL;
+
+	va_start(keys, key);
+	for (n = 0, k = key; n < path->n; n++, k = va_arg(keys, const char *))
+		part_init(&path->p[n], mmatic_strdup(mm, k), strlen(k));
+	va_end(keys);
+
+	return path;
+}
+
+/** Get idx-th element of a list, without touching the list iterator */
+static ut *list_get(tlist *list, int64_t idx)
+{
+	tlist_el *el;
+
+	if (idx < 0 || idx >= list->size)
+		return NULL;
+
+	for (el = list->head; idx > 0; idx--)
+		el = el->next;
+
+	return el->val;
+}
+
+ut *utpath_get(const utpath *path, ut *node)
+{
+	const struct utpath_part *part;
+	uint32_t i;
+
+	for (i = 0; node && i < path->n; i++) {
+		part = &path->p[i];
+
+		switch (ut_type(node)) {
+			case T_HASH:
+				node = thash_get_hashed(node->d.as_thash, part->key, part->len, part->hash);
+				break;
+			case T_ARRAY:
+				node = (part->idx >= 0 && part->idx < uta_count(node)) ? uta_get(node, part->idx) : NULL;
+				break;
+			case T_LIST:
+				node = list_get(node->d.as_tlist, part->idx);
+				break;
+			default:
+				return NULL;
+		}
+	}
+
+	return node;
+}
+
+/** True if part refers to the end of a list or array, as in RFC 6901 */
+#define PART_END(part, size) ((part)->idx == (size) || ((part)->len == 1 && (part)->key[0] == '-'))
+
+/** utpath_with() starting at component i, for which node is the current value (may be NULL) */
+static ut *with(const utpath *path, uint32_t i, ut *node, ut *val, void *mm)
+{
+	const struct utpath_part *part;
+	tlist_el *el;
+	ut *copy, *child;
+	int64_t j;
+
+	if (i == path->n)
+		return val;
+
+	part = &path->p[i];
+
+	if (ut_is_thash(node) || ut_is_tlist(node) || ut_is_array(node))
+		copy = ut_copy(node, mm);
+	else
+		copy = ut_new_utthash(NULL, mm);
+
+	switch (copy->type) {
+		case T_HASH:
+			child = thash_get_hashed(copy->d.as_thash, part->key, part->len, part->hash);
+			child = with(path, i + 1, child, val, mm);
+			if (!child) goto fail;
+
+			/* drops the reference copy took to the old child */
+			thash_set(copy->d.as_thash, part->key, child);
+			return copy;
+
+		case T_LIST:
+			if (PART_END(part, copy->d.as_tlist->size)) {
+				child = with(path, i + 1, NULL, val, mm);
+				if (!child) goto fail;
+
+				tlist_push(copy->d.as_tlist, child);
+				return copy;
+			}
+
+			if (part->idx < 0 || part->idx >= copy->d.as_tlist->size)
+				goto out_of_range;
+
+			for (el = copy->d.as_tlist->head, j = part->idx; j > 0; j--)
+				el = el->next;
+
+			child = with(path, i + 1, el->val, val, mm);
+			if (!child) goto fail;
+
+			ut_free(el->val);
+			el->val = child;
+			return copy;
+
+		case T_ARRAY:
+			if (PART_END(part, uta_count(copy))) {
+				child = with(path, i + 1, NULL, val, mm);
+				if (!child) goto fail;
+
+				uta_add(copy, child);
+				return copy;
+			}
+
+			if (part->idx < 0 || part->idx >= uta_count(copy))
+				goto out_of_range;
+
+			child = with(path, i + 1, uta_get(copy, part->idx), val, mm);
+			if (!child) goto fail;
+
+			uta_set(copy, part->idx, child);
+			return copy;
+
+		default:
+			break;
+	}
+
+out_of_range:
+	ut_free(val);
+fail:
+	ut_free(copy);
+	return NULL;
+}
+
+ut *utpath_with(const utpath *path, ut *root, ut *val)
+{
+	if (path->n == 0)
+		return val;
+
+	return with(path, 0, root, val, ut_mm(root));
+}
+
+void utpath_free(utpath *path)
+{
+	uint32_t i;
+
+	if (!path) return;
+
+	for (i = 0; i < path->n; i++)
+		mmatic_free(path->p[i].key);
+
+	if (path->p)
+		mmatic_free(path->p);
+
+	mmatic_free(path);
+}
@@ -0,0 +1,107 @@
+/*
+ * utpath - precompiled paths into unitype trees
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _UTPATH_H_
+#define _UTPATH_H_
+
+#include <stdint.h>
+
+#include "unitype.h"
+
+/** One path component */
+struct utpath_part {
+	/** Key, \0-terminated and unescaped */
+	char *key;
+
+	/** Key length */
+	size_t len;
+
+	/** thash_str_hash() of key */
+	unsigned int hash;
+
+	/** Index in T_LIST or T_ARRAY, -1 if key is not a valid one */
+	int64_t idx;
+};
+
+/** A compiled path into unitype trees
+ *
+ * Parse the path once with utpath_compile(), then evaluate it with utpath_get() against many trees.
+ * Keys are hashed at compile time, so evaluation does no string hashing nor parsing. */
+typedef struct utpath {
+	/** Components */
+	struct utpath_part *p;
+
+	/** Number of components */
+	uint32_t n;
+} utpath;
+
+/** Compile a JSON Pointer (RFC 6901)
+ *
+ * Path is either empty (the root itself) or a sequence of "/key" components, with "~1" standing for
+ * "/" and "~0" for "~" in keys. Components made of digits only (without leading zeros) are also
+ * used as indices when the path goes through a T_LIST or T_ARRAY.
+ *
+ * @param ptr   path, eg. "/http/headers/host"
+ * @param mm    memory manager
+ * @retval NULL ptr is not a valid JSON Pointer
+ */
+utpath *utpath_compile(const char *ptr, void *mm);
+
+/** Compile a path given as a list of keys, as in uth_path_get()
+ * @param key   first key; give next keys in following arguments, NULL ends the list
+ * @note keys are not unescaped */
+utpath *utpath_keys_(void *mm, const char *key, ...);
+
+/** Wrapper of utpath_keys_() which adds NULL as the last key */
+#define utpath_keys(mm, ...) utpath_keys_((mm), __VA_ARGS__, NULL)
+
+/** Evaluate path against a tree
+ * @retval NULL  path does not exist in root */
+ut *utpath_get(const utpath *path, ut *root);
+
+/** Make a modified copy of a tree, with val put at path
+ *
+ * The nodes on path are copied, everything else is shared with root - see ut_ref(). Missing keys
+ * and non-container nodes on the way are replaced with new hashes, as in uth_path_create(). In lists
+ * and arrays, index equal to their size or "-" appends a new element.
+ *
+ * @param root   tree to start from, left unchanged
+ * @param val    new value, which is consumed; may be a shared node
+ * @return       new root, allocated next to root; val itself if path is empty
+ * @retval NULL  path goes through a list or array index which is out of range; val is freed
+ */
+ut *utpath_with(const utpath *path, ut *root, ut *val);
+
+/** Free compiled path */
+void utpath_free(utpath *path);
+
+/** Shortcuts for getting values by compiled path, as in uthp_*() */
+#define utp_bool(path, var)   ut_bool(utpath_get((path), (var)))
+#define utp_int(path, var)    ut_int(utpath_get((path), (var)))
+#define utp_uint(path, var)   ut_uint(utpath_get((path), (var)))
+#define utp_double(path, var) ut_double(utpath_get((path), (var)))
+#define utp_xstr(path, var)   ut_xstr(utpath_get((path), (var)))
+#define utp_char(path, var)   ut_char(utpath_get((path), (var)))
+#define utp_ptr(path, var)    ut_ptr(utpath_get((path), (var)))
+#define utp_tlist(path, var)  ut_tlist(utpath_get((path), (var)))
+#define utp_thash(path, var)  ut_thash(utpath_get((path), (var)))
+
+#endif /* _UTPATH_H_ */
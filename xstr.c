@@ -26,11 +26,18 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 
 #include "lib.h"
 
 #define xmmatic_alloc(mm, size) (mmatic_alloc(xs, (size)))
 
+/** Default size of reads from file descriptors */
+#define XSTR_READ_CHUNK 8192
+
 /**
  * @file xstr.c
  * Implement string-like structure to allow easy
@@ -79,14 +86,24 @@ void xstr_reserve(xstr *xs, size_t l)
 {
 	char *new_str;
 
-	if (xs->a > l)
+	if (xs->s && xs->a >= l)
 		return;
 
+	/* short string in fresh xstr: no need for separate memory */
+	if (!xs->s && l < XSTR_INLINE) {
+		xs->s = xs->in;
+		xs->s[0] = 0;
+		xs->len = 0;
+		xs->a = XSTR_INLINE - 1;
+		return;
+	}
+
 	new_str = xmmatic_alloc(mm, l + 1);
 
 	if (xs->s) {
 		memcpy(new_str, xs->s, xs->len + 1);
-		mmatic_free(xs->s);
+		if (!xstr_is_inline(xs))
+			mmatic_free(xs->s);
 		xs->s = new_str;
 	} else {
 		xs->s = new_str;
@@ -97,58 +114,120 @@ void xstr_reserve(xstr *xs, size_t l)
 	xs->a = l;
 }
 
+void xstr_grow(xstr *xs, size_t l)
+{
+	if (xs->s && xs->a >= l)
+		return;
+
+	/* fresh xstr: let xstr_reserve() decide whether l fits inline */
+	if (xs->s)
+		l = MAX(l, 2 * xs->a);
+
+	xstr_reserve(xs, l);
+}
+
 void xstr_append(xstr *sx, const char *s)
 {
-	int slen;
+	if (s)
+		xstr_append_size(sx, s, strlen(s));
+}
 
-	if (!s)
-		return;
+void xstr_append_int(xstr *sx, long long v)
+{
+	char buf[PJF_NUMBUF];
+	xstr_append_size(sx, buf, pjf_itoa(v, buf));
+}
 
-	slen = strlen(s);
-	if (!slen)
-		return;
+void xstr_append_uint(xstr *sx, unsigned long long v)
+{
+	char buf[PJF_NUMBUF];
+	xstr_append_size(sx, buf, pjf_utoa(v, buf));
+}
 
-	slen += sx->len;
-	xstr_reserve(sx, slen);
-	strcat(sx->s, s);
-	sx->len = slen;
+void xstr_append_double(xstr *sx, double v)
+{
+	char buf[PJF_NUMBUF];
+	xstr_append_size(sx, buf, pjf_dtoa(v, buf));
 }
 
-void xstr_append_size(xstr *sx, const char *s, int size)
+ssize_t xstr_append_fd(xstr *xs, int fd, size_t hint)
 {
-	int slen;
+	ssize_t rc;
 
-	if (!s || size == 0)
-		return;
+	if (hint == 0)
+		hint = XSTR_READ_CHUNK;
+
+	if (!xs->s || xs->a - xs->len < hint)
+		xstr_grow(xs, xs->len + hint);
+
+	do {
+		rc = read(fd, xs->s + xs->len, xs->a - xs->len);
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc > 0) {
+		xs->len += rc;
+		xs->s[xs->len] = '\0';
+	}
+
+	return rc;
+}
+
+ssize_t xstr_slurp_fd(xstr *xs, int fd)
+{
+	struct stat st;
+	off_t pos;
+	size_t hint = 0, next = 0;
+	ssize_t rc, total = 0;
+	int avail;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		/* whole rest of file in one read, plus a spare byte to see EOF without growing */
+		pos = lseek(fd, 0, SEEK_CUR);
+		if (pos >= 0 && st.st_size >= pos)
+			hint = st.st_size - pos + 1;
+		next = 1;
+	} else if (ioctl(fd, FIONREAD, &avail) == 0 && avail > 0) {
+		hint = avail;
+	}
 
-	slen = sx->len + size;
-	xstr_reserve(sx, slen);
+	while ((rc = xstr_append_fd(xs, fd, hint)) > 0) {
+		total += rc;
+		hint = next;
+	}
 
-	memcpy(sx->s + sx->len, s, size);
-	sx->len = slen;
-	sx->s[sx->len] = '\0';
+	return rc < 0 ? -1 : total;
 }
 
-void xstr_append_char(xstr *sx, char s)
+ssize_t xstr_write_fd_range(xstr *xs, int fd, size_t off, size_t len)
 {
-	/* hack to overcome relocating memory sequential calls (eg. loops) */
-	if (sx->len + 2 >= sx->a);
-		xstr_reserve(sx, MAX(8, 2 * sx->len));
+	ssize_t rc;
+	size_t done = 0;
+
+	if (off > xs->len) off = xs->len;
+	if (len > xs->len - off) len = xs->len - off;
+
+	while (done < len) {
+		rc = write(fd, xs->s + off + done, len - done);
+		if (rc < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		done += rc;
+	}
 
-	sx->s[sx->len++] = s;
-	sx->s[sx->len] = 0;
+	return done;
 }
 
 void xstr_set(xstr *xs, const char *s)
 {
-	int l = strlen(s);
+	size_t l = strlen(s);
 
 	xstr_reserve(xs, l);
 	strcpy(xs->s, s);
 	xs->len = l;
 }
 
-void xstr_set_size(xstr *xs, const char *s, int size)
+void xstr_set_size(xstr *xs, const char *s, size_t size)
 {
 	xstr_reserve(xs, size);
 	memcpy(xs->s, s, size);
@@ -159,7 +238,8 @@ void xstr_set_size(xstr *xs, const char *s, int size)
 void xstr_free(xstr *xs)
 {
 	if (xs->s) {
-		mmatic_free(xs->s);
+		if (!xstr_is_inline(xs))
+			mmatic_free(xs->s);
 		xs->s = 0;
 		xs->len = 0;
 		xs->a = 0;
@@ -169,11 +249,12 @@ void xstr_free(xstr *xs)
 char *xstr_strip(xstr *xs)
 {
 	char *ret;
-	int i,j;
-	int b;
+	ssize_t i, j, b;
 
-	for (i = 0; i < xs->len; ++i) if (isgraph(xs->s[i])) break;
-	for (j = xs->len; j >= i; --j) if (isgraph(xs->s[j])) break;
+	/* whitespace is what usually needs stripping - skip it fast, then check the rest */
+	i = xs->len ? pjf_scan_ws(xs->s) - xs->s : 0;
+	for (; i < xs->len; ++i) if (isgraph((unsigned char) xs->s[i])) break;
+	for (j = xs->len - 1; j >= i; --j) if (isgraph((unsigned char) xs->s[j])) break;
 
 	ret = xmmatic_alloc(mm, sizeof(char) * (j-i + 2));
 	for (b = 0; i < j+1; i++, b++) ret[b] = xs->s[i];
@@ -201,12 +282,14 @@ char *xstr_stripch(char *string, void *mm)
 int xstr_set_format(xstr *xs, const char *format, ...)
 {
 	int len;
-	va_list args;
+	va_list args, args2;
 
 	va_start(args, format);
+	va_copy(args2, args);
 	len = vsnprintf(NULL, 0, format, args);
 	xstr_reserve(xs, len);
-	if (vsnprintf(xs->s, xs->a + 1, format, args) != len) len = -1;
+	if (vsnprintf(xs->s, xs->a + 1, format, args2) != len) len = -1;
+	va_end(args2);
 	va_end(args);
 
 	if (len > 0) xs->len = len;
@@ -218,13 +301,15 @@ int xstr_append_format(xstr *xs, const char *format, ...)
 {
 	char *ptr;
 	int len;
-	va_list args;
+	va_list args, args2;
 
 	va_start(args, format);
+	va_copy(args2, args);
 	len = vsnprintf(NULL, 0, format, args);
-	xstr_reserve(xs, xs->len + len);
+	xstr_grow(xs, xs->len + len);
 	ptr = xs->s + xs->len;
-	if (vsnprintf(ptr, xs->a - xs->len + 1, format, args) != len) len = -1;
+	if (vsnprintf(ptr, xs->a - xs->len + 1, format, args2) != len) len = -1;
+	va_end(args2);
 	va_end(args);
 
 	if (len > 0) xs->len += len;
@@ -232,7 +317,7 @@ int xstr_append_format(xstr *xs, const char *format, ...)
 	return len;
 }
 
-void xstr_cut(xstr *xs, unsigned int l)
+void xstr_cut(xstr *xs, size_t l)
 {
 	if (l > xs->len) return;
 	xs->len -= l;
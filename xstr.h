@@ -27,20 +27,31 @@
 
 #include <ctype.h>
 #include <stdarg.h>
+#include <sys/types.h>
 
 #include "mmatic.h"
 
+/** Strings shorter than that are kept inside the xstr itself */
+#define XSTR_INLINE 24
+
 typedef struct xstr {
-	/** Pointer to allocated memory */
+	/** Pointer to allocated memory, or to in[] for short strings */
 	char *s;
 
 	/** Current length of *s */
-	unsigned int len;
+	size_t len;
+
+	/** Reserved memory, not counting the trailing \0; always a >= len */
+	size_t a;
 
-	/** Reserved memory; always a >= len + 1 */
-	unsigned int a;
+	/** Inline storage for short strings, saves a separate allocation
+	 * @note hence an xstr must not be copied by value */
+	char in[XSTR_INLINE];
 } xstr;
 
+/** True if xstr value lives in xs->in[] and not in separate memory */
+#define xstr_is_inline(xs) ((xs)->s == (xs)->in)
+
 /** Create an xstr object
  * @param str    initial value; if NULL, "" is assumed
  * @return allocated memory */
@@ -59,23 +70,78 @@ char *xstr_to_char(xstr *sx);
 /** Duplicate string */
 char *xstr_dup(xstr *sx, void *mm);
 
-/** Allocate more space in buffer */
+/** Allocate more space in buffer, exactly for l chars */
 void xstr_reserve(xstr *sx, size_t l);
 
+/** Make place for at least l chars, at least doubling current reservation
+ * Use when appending in a loop: amortized cost of one append is then O(1) */
+void xstr_grow(xstr *sx, size_t l);
+
 /** Append string to xstr */
 void xstr_append(xstr *sx, const char *s);
 
 /** Append string of length size to xstr */
-void xstr_append_size(xstr *sx, const char *s, int size);
+static inline void xstr_append_size(xstr *sx, const char *s, size_t size)
+{
+	if (!s || size == 0)
+		return;
+
+	if (sx->len + size > sx->a)
+		xstr_grow(sx, sx->len + size);
+
+	memcpy(sx->s + sx->len, s, size);
+	sx->len += size;
+	sx->s[sx->len] = '\0';
+}
 
 /** Append one char to xstr */
-void xstr_append_char(xstr *sx, char s);
+static inline void xstr_append_char(xstr *sx, char s)
+{
+	if (sx->len + 1 > sx->a)
+		xstr_grow(sx, sx->len + 1);
+
+	sx->s[sx->len++] = s;
+	sx->s[sx->len] = '\0';
+}
+
+/** Append signed integer in decimal */
+void xstr_append_int(xstr *sx, long long v);
+
+/** Append unsigned integer in decimal */
+void xstr_append_uint(xstr *sx, unsigned long long v);
+
+/** Append double as shortest text which reads back the same
+ * @see pjf_dtoa() */
+void xstr_append_double(xstr *sx, double v);
+
+/** Read once from fd straight into spare space at the end of xstr
+ * @param hint   make sure there is room for at least that many bytes first; 0 means a default
+ *               chunk size
+ * @note retries on EINTR
+ * @return       read() return value: number of bytes appended, 0 on EOF, -1 on error */
+ssize_t xstr_append_fd(xstr *xs, int fd, size_t hint);
+
+/** Read everything from fd until EOF, appending to xstr
+ * Initial reservation is sized from fstat() for regular files, or FIONREAD otherwise.
+ * @retval -1    read error, see errno
+ * @return       number of bytes appended */
+ssize_t xstr_slurp_fd(xstr *xs, int fd);
+
+/** Write len bytes of xstr starting at off to fd
+ * @note handles partial writes and EINTR; range is clipped to xstr contents
+ * @retval -1    write error, see errno
+ * @return       number of bytes written */
+ssize_t xstr_write_fd_range(xstr *xs, int fd, size_t off, size_t len);
+
+/** Write whole xstr to fd
+ * @see xstr_write_fd_range() */
+#define xstr_write_fd(xs, fd) xstr_write_fd_range((xs), (fd), 0, (xs)->len)
 
 /** Set xstr value */
 void xstr_set(xstr *xs, const char *s);
 
 /** Set xstr value to string s of size size */
-void xstr_set_size(xstr *xs, const char *s, int size);
+void xstr_set_size(xstr *xs, const char *s, size_t size);
 
 /** Dellocate memory */
 void xstr_free(xstr *xs);
@@ -110,6 +176,6 @@ int xstr_set_format(xstr *xs, const char *format, ...);
 int xstr_append_format(xstr *xs, const char *format, ...);
 
 /** Cut the string @l byte starting from the end */
-void xstr_cut(xstr *xs, unsigned int l);
+void xstr_cut(xstr *xs, size_t l);
 
 #endif
@@ -0,0 +1,115 @@
+/*
+ * xsv - non-owning string views
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* memmem() */
+#include <string.h>
+#include <limits.h>
+
+#include "lib.h"
+
+int xsv_cmp(xstr_view a, xstr_view b)
+{
+	int rc = memcmp(a.s, b.s, MIN(a.len, b.len));
+
+	if (rc) return rc;
+	return (a.len > b.len) - (a.len < b.len);
+}
+
+unsigned int xsv_hash(xstr_view v)
+{
+	return thash_str_hash_len(v.s, v.len);
+}
+
+ssize_t xsv_chr(xstr_view v, char c)
+{
+	const char *p = memchr(v.s, c, v.len);
+	return p ? p - v.s : -1;
+}
+
+ssize_t xsv_find(xstr_view v, xstr_view needle)
+{
+	const char *p = memmem(v.s, v.len, needle.s, needle.len);
+	return p ? p - v.s : -1;
+}
+
+xstr_view xsv_trim(xstr_view v)
+{
+	while (v.len > 0 && PJF_IS_WS(v.s[0])) { v.s++; v.len--; }
+	while (v.len > 0 && PJF_IS_WS(v.s[v.len - 1])) v.len--;
+
+	return v;
+}
+
+bool xsv_split(xstr_view *v, char delim, xstr_view *tok)
+{
+	ssize_t i;
+
+	if (!v->s) return false;
+
+	i = xsv_chr(*v, delim);
+	if (i < 0) {
+		/* last token - mark v as consumed */
+		*tok = *v;
+		v->s = NULL;
+		v->len = 0;
+	} else {
+		*tok = xsv_size(v->s, i);
+		v->s += i + 1;
+		v->len -= i + 1;
+	}
+
+	return true;
+}
+
+bool xsv_tol(xstr_view v, long long *out)
+{
+	unsigned long long n = 0, max = LLONG_MAX;
+	bool neg = false;
+	size_t i = 0;
+	int d;
+
+	if (v.len > 0 && (v.s[0] == '-' || v.s[0] == '+')) {
+		neg = (v.s[0] == '-');
+		max += neg;
+		i++;
+	}
+
+	if (i == v.len) return false;
+
+	for (; i < v.len; i++) {
+		d = v.s[i] - '0';
+		if (d < 0 || d > 9) return false;
+		if (n > (max - d) / 10) return false;
+		n = n * 10 + d;
+	}
+
+	*out = neg ? (long long) -n : (long long) n;
+	return true;
+}
+
+char *xsv_dup(xstr_view v, void *mm)
+{
+	char *ret = mmatic_alloc(mm, v.len + 1);
+
+	memcpy(ret, v.s, v.len);
+	ret[v.len] = '\0';
+
+	return ret;
+}
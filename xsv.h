@@ -0,0 +1,125 @@
+/*
+ * xsv - non-owning string views
+ *
+ * This file is part of libpjf
+ * Copyright (C) 2011 Paweł Foremski <pawel@foremski.pl>
+ *
+ * libpjf is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libpjf is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _XSV_H_
+#define _XSV_H_
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "xstr.h"
+
+/** A slice of some other string: pointer and length, not \0-terminated
+ *
+ * Views never own memory - the underlying string must outlive them. Use them to look at parts of
+ * a buffer without copying, eg. while parsing. */
+typedef struct xstr_view {
+	/** First character */
+	const char *s;
+
+	/** Length */
+	size_t len;
+} xstr_view;
+
+/** View of size bytes at s */
+static inline xstr_view xsv_size(const char *s, size_t size)
+{
+	xstr_view v = { s, size };
+	return v;
+}
+
+/** View of \0-terminated string s, NULL giving an empty view */
+static inline xstr_view xsv(const char *s)
+{
+	return xsv_size(s ? s : "", s ? strlen(s) : 0);
+}
+
+/** View of current xstr contents
+ * @note invalidated by any change to xs */
+static inline xstr_view xsv_xstr(const xstr *xs)
+{
+	return xsv_size(xs->s ? xs->s : "", xs->len);
+}
+
+/** Sub-view of len bytes starting at off, clipped to v */
+static inline xstr_view xsv_sub(xstr_view v, size_t off, size_t len)
+{
+	if (off > v.len) off = v.len;
+	if (len > v.len - off) len = v.len - off;
+	return xsv_size(v.s + off, len);
+}
+
+/** True if views have the same contents */
+static inline bool xsv_eq(xstr_view a, xstr_view b)
+{
+	return a.len == b.len && memcmp(a.s, b.s, a.len) == 0;
+}
+
+/** True if view equals \0-terminated string s */
+static inline bool xsv_eq_str(xstr_view v, const char *s)
+{
+	return !memchr(v.s, 0, v.len) && strncmp(v.s, s, v.len) == 0 && s[v.len] == '\0';
+}
+
+/** True if v begins with prefix */
+static inline bool xsv_starts(xstr_view v, xstr_view prefix)
+{
+	return v.len >= prefix.len && memcmp(v.s, prefix.s, prefix.len) == 0;
+}
+
+/** Compare like strcmp() */
+int xsv_cmp(xstr_view a, xstr_view b);
+
+/** Hash view contents
+ * @note gives the same value as thash_str_hash() on equal \0-terminated string */
+unsigned int xsv_hash(xstr_view v);
+
+/** Find first occurence of c
+ * @retval -1  not found
+ * @return     offset of c in v */
+ssize_t xsv_chr(xstr_view v, char c);
+
+/** Find first occurence of needle
+ * @retval -1  not found
+ * @return     offset of needle in v */
+ssize_t xsv_find(xstr_view v, xstr_view needle);
+
+/** Strip whitespace from both sides, as in pjf_scan_ws() */
+xstr_view xsv_trim(xstr_view v);
+
+/** Split v at delimiter
+ *
+ * Stores part before first delim in *tok and advances *v past the delimiter. Typical loop:
+ * while (xsv_split(&rest, ',', &tok)) { ... }
+ *
+ * @retval false  nothing left in *v */
+bool xsv_split(xstr_view *v, char delim, xstr_view *tok);
+
+/** Parse signed integer from whole v
+ * @retval false  v is not a valid base-10 integer, or it overflows */
+bool xsv_tol(xstr_view v, long long *out);
+
+/** Make a \0-terminated copy of v in mm */
+char *xsv_dup(xstr_view v, void *mm);
+
+/** Append view to xstr */
+#define xstr_append_view(xs, v) do { xstr_view v_ = (v); xstr_append_size((xs), v_.s, v_.len); } while (0)
+
+#endif /* _XSV_H_ */